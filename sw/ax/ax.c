@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stddef.h>
 
 #define USE_MATH_H
 #ifdef USE_MATH_H
@@ -48,6 +49,22 @@
 
 #define MIN(a,b) ((a < b) ? (a) : (b))
 
+/* refill the tx fifo once this many bytes are free */
+#define AX_FIFO_TX_REFILL	128
+/* fifo bytes that fit in one spi transaction */
+#define AX_FIFO_TX_MAX_WRITE	254
+/* size of the radio's fifo */
+#define AX_FIFO_SIZE		256
+/* sync word sent after the preamble, if not set in ax_modulation */
+#define AX_TX_SYNC_WORD		0x55335533
+
+/* ax_pinfunc set bits */
+#define AX_PINFUNC_SYSCLK	(1 << 0)
+#define AX_PINFUNC_DCLK		(1 << 1)
+#define AX_PINFUNC_DATA		(1 << 2)
+#define AX_PINFUNC_ANTSEL	(1 << 3)
+#define AX_PINFUNC_PWRAMP	(1 << 4)
+
 typedef struct ax_synthesiser_parameters {
   uint8_t loop, charge_pump_current;
 } ax_synthesiser_parameters;
@@ -58,12 +75,6 @@ void ax_set_synthesiser_parameters(ax_config* config,
                                    ax_synthesiser* synth,
                                    enum ax_vco_type vco_type);
 
-pinfunc_t _pinfunc_sysclk	= 1;
-pinfunc_t _pinfunc_dclk		= 1;
-pinfunc_t _pinfunc_data		= 1;
-pinfunc_t _pinfunc_antsel	= 1;
-pinfunc_t _pinfunc_pwramp	= 7;
-
 /**
  * FIFO -----------------------------------------------------
  */
@@ -75,6 +86,9 @@ void ax_fifo_clear(ax_config* config)
 {
   ax_hw_write_register_8(config, AX_REG_FIFOSTAT,
                          AX_FIFOCMD_CLEAR_FIFO_DATA_AND_FLAGS);
+  config->state.fifo_rx_offset = 0;
+  config->state.fifo_rx_length = 0;
+  config->state.fifo_rx_count = 0;
 }
 /**
  * Commits data written to the fifo
@@ -85,18 +99,103 @@ void ax_fifo_commit(ax_config* config)
                          AX_FIFOCMD_COMMIT);
 }
 
+/**
+ * Waits until at least `free` bytes in the fifo are free.
+ *
+ * Sleeps on the FIFOTHRFREE interrupt if there's an irq_wait function,
+ * or otherwise for about as long as the missing bytes take to send if
+ * there's a sleep_us function. Failing both, polls FIFOFREE.
+ *
+ * returns the number of bytes free
+ */
+static uint16_t ax_fifo_wait_free(ax_config* config, uint16_t free)
+{
+  ax_tx_stats* stats = &config->state.tx_stats;
+  uint16_t fifofree;
+  uint32_t wait_us = 0;
+  uint32_t start = 0;
+  uint8_t waited = 0;
+
+  /* only we add to the fifo, so if it was empty last transaction it
+   * still is. a commit's status is from before the commit, so isn't
+   * counted as empty */
+  if (ax_hw_status_fifo_empty(ax_hw_status(config))) {
+    return AX_FIFO_SIZE;
+  }
+
+  fifofree = ax_hw_read_register_16(config, AX_REG_FIFOFREE);
+
+  while (fifofree < free) {
+
+    if (fifofree < stats->fifofree_min) { stats->fifofree_min = fifofree; }
+    if (!waited) {
+      stats->waits++;
+      if (config->time_us) { start = config->time_us(); }
+      waited = 1;
+    }
+
+    /* time to transmit the missing bytes */
+    if (config->state.tx_byte_rate) {
+      wait_us = ((uint32_t)(free - fifofree) * 1000000) /
+        config->state.tx_byte_rate;
+    }
+
+    if (config->irq_wait) {     /* interrupt */
+      ax_hw_write_register_16(config, AX_REG_FIFOTHRESH, free - 1);
+      ax_hw_write_register_16(config, AX_REG_IRQMASK, AX_IRQMFIFOTHRFREE);
+
+      /* the space may have appeared before the mask was set, in which
+       * case there's no edge to come */
+      fifofree = ax_hw_read_register_16(config, AX_REG_FIFOFREE);
+      if (fifofree < free) {
+        /* timeout in case the edge is missed */
+        config->irq_wait(config, (wait_us / 1000) + 10);
+        fifofree = ax_hw_read_register_16(config, AX_REG_FIFOFREE);
+      }
+
+      ax_hw_write_register_16(config, AX_REG_IRQMASK, 0);
+
+    } else {
+      if (config->sleep_us) {   /* sleep */
+        config->sleep_us(wait_us);
+      }
+      fifofree = ax_hw_read_register_16(config, AX_REG_FIFOFREE);
+    }
+  }
+
+  if (fifofree < stats->fifofree_min) { stats->fifofree_min = fifofree; }
+  if (waited && config->time_us) {
+    stats->wait_us += config->time_us() - start;
+  }
+
+  return fifofree;
+}
+/**
+ * Counts the fifo error flags, if the status says any are set.
+ * Reading FIFOSTAT clears them
+ */
+static void ax_fifo_tx_check_flags(ax_config* config, uint16_t status)
+{
+  ax_tx_stats* stats = &config->state.tx_stats;
+  uint8_t fifostat;
+
+  if (status & (AX_STATUS_FIFO_OVERFLOW | AX_STATUS_FIFO_UNDERFLOW)) {
+    fifostat = ax_hw_read_register_8(config, AX_REG_FIFOSTAT);
+
+    if (fifostat & AX_FIFO_UNDER) { stats->underruns++; }
+    if (fifostat & AX_FIFO_OVER)  { stats->overruns++; }
+  }
+}
+
 /**
  * write tx 1k zeros
  */
 void ax_fifo_tx_1k_zeros(ax_config* config)
 {
   uint8_t header[4];
-  uint8_t fifocount;
 
   /* wait for enough space to contain command */
-  do {
-    fifocount = ax_hw_read_register_16(config, AX_REG_FIFOCOUNT);
-  } while (fifocount > (256 - 4));
+  ax_fifo_wait_free(config, 4);
 
   /* preamble */
   header[0] = AX_FIFO_CHUNK_REPEATDATA;
@@ -108,179 +207,413 @@ void ax_fifo_tx_1k_zeros(ax_config* config)
 }
 
 /**
- * write tx data
+ * write tx stream
+ *
+ * Keeps the fifo topped up with raw DATA chunks from stream, until the
+ * producer ends it
  */
-void ax_fifo_tx_data(ax_config* config, ax_modulation* mod,
-                     uint8_t* data, uint16_t length)
+static void ax_fifo_tx_stream(ax_config* config, ax_tx_stream* stream)
 {
-  uint8_t header[8];
-  uint8_t fifocount;
-  uint8_t chunk_length;
-  uint16_t rem_length;
-  uint8_t pkt_end = 0;
+  uint8_t chunk[AX_FIFO_TX_MAX_WRITE];
+  uint16_t fifofree;
+  uint16_t status;
+  int32_t length;
+  uint8_t started = 0;
 
-  /* send remainder first */
-  chunk_length = length % 200;
-  rem_length = length - chunk_length;
+  chunk[0] = AX_FIFO_CHUNK_DATA;
+  chunk[2] = AX_FIFO_TXDATA_RAW | AX_FIFO_TXDATA_NOCRC |
+    (stream->unencoded ? AX_FIFO_TXDATA_UNENC : 0);
 
-  if (length <= 200) {           /* all in one go */
-    pkt_end = AX_FIFO_TXDATA_PKTEND;
+  while (1) {
+    /* wait for space for a chunk */
+    fifofree = ax_fifo_wait_free(config, 3 + AX_FIFO_TX_REFILL);
+
+    /* get data, straight into the chunk */
+    length = stream->produce(stream, chunk + 3,
+                             MIN(fifofree, AX_FIFO_TX_MAX_WRITE) - 3);
+    if (length < 0) {
+      break;                    /* end of stream */
+    }
+    if (length == 0) {          /* producer is behind, try again soon */
+      if (config->sleep_us) { config->sleep_us(1000); }
+      continue;
+    }
+
+    /* write chunk. not batched, as the status from this transaction
+     * says if the fifo was empty just before it */
+    chunk[1] = length + 1;      /* incl flags */
+    status = ax_hw_write_fifo(config, chunk, length + 3);
+    ax_fifo_commit(config);     /* commit */
+    ax_fifo_tx_check_flags(config, status);
+    config->state.tx_stats.bytes += length;
+    config->state.tx_stats.fifo_bytes += length + 3;
+
+    /* empty fifo means the transmitter ran out */
+    if (started && ax_hw_status_fifo_empty(status)) {
+      stream->underruns++;
+      if (stream->underrun) { stream->underrun(stream); }
+    }
+
+    stream->bytes += length;
+    started = 1;
   }
+}
+/**
+ * Compiles the preamble and sync word for mod into the fifo chunks
+ * that start every packet
+ */
+static void ax_tx_template_compile(ax_modulation* mod)
+{
+  ax_tx_template* tmpl = &mod->tx_template;
+  uint32_t sync_word = mod->sync_word ? mod->sync_word : AX_TX_SYNC_WORD;
+  uint8_t* ptr = tmpl->prefix;
 
-  /* wait for enough space to contain both the preamble and chunk */
-  do {
-    fifocount = ax_hw_read_register_16(config, AX_REG_FIFOCOUNT);
-  } while (fifocount > (256 - (chunk_length+20)));
+  /* include length byte? */
+  tmpl->length_byte =
+    !(((mod->framing & 0xE) == AX_FRAMING_MODE_HDLC) || /* hdlc */
+      (mod->fixed_packet_length)); /* or fixed length */
 
-  /* write preamble */
+  /* preamble */
+  *ptr++ = AX_FIFO_CHUNK_REPEATDATA;
+  *ptr++ = AX_FIFO_TXDATA_UNENC | AX_FIFO_TXDATA_RAW | AX_FIFO_TXDATA_NOCRC;
   switch (mod->framing & 0xE) {
     case AX_FRAMING_MODE_HDLC:
-      /* preamble */
-      header[0] = AX_FIFO_CHUNK_REPEATDATA;
-      header[1] = AX_FIFO_TXDATA_UNENC | AX_FIFO_TXDATA_RAW | AX_FIFO_TXDATA_NOCRC;
-      header[2] = 9;
-      header[3] = 0x7E;
-      ax_hw_write_fifo(config, header, 4);
+      *ptr++ = mod->preamble_length ? mod->preamble_length : 9;
+      *ptr++ = 0x7E;
+      tmpl->prefix_air_bytes = ptr[-2];
       break;
     default:
-      /* preamble */
-      header[0] = AX_FIFO_CHUNK_REPEATDATA;
-      header[1] = AX_FIFO_TXDATA_UNENC | AX_FIFO_TXDATA_RAW | AX_FIFO_TXDATA_NOCRC;
-      header[2] = 4;
-      header[3] = 0xAA;
-      ax_hw_write_fifo(config, header, 4);
+      *ptr++ = mod->preamble_length ? mod->preamble_length : 4;
+      *ptr++ = 0xAA;
 
       /* sync word */
-      header[0] = AX_FIFO_CHUNK_DATA;
-      header[1] = 4+1;         /* incl flags */
-      header[2] = AX_FIFO_TXDATA_RAW | AX_FIFO_TXDATA_NOCRC;
-      header[3] = 0x33;
-      header[4] = 0x55;
-      header[5] = 0x33;
-      header[6] = 0x55;
-      ax_hw_write_fifo(config, header, header[1]+2);
+      *ptr++ = AX_FIFO_CHUNK_DATA;
+      *ptr++ = 4+1;             /* incl flags */
+      *ptr++ = AX_FIFO_TXDATA_RAW | AX_FIFO_TXDATA_NOCRC;
+      *ptr++ = (sync_word >>  0) & 0xFF;
+      *ptr++ = (sync_word >>  8) & 0xFF;
+      *ptr++ = (sync_word >> 16) & 0xFF;
+      *ptr++ = (sync_word >> 24) & 0xFF;
+      tmpl->prefix_air_bytes = tmpl->prefix[2] + 4;
       break;
   }
 
-  /* write first data */
-  if (((mod->framing & 0xE) == AX_FRAMING_MODE_HDLC) || /* hdlc */
-      (mod->fixed_packet_length) || /* or fixed length */
-      (length >= 255)       /* or can't include length byte anyhow */
-    ) {
-    /* no length byte */
-    header[0] = AX_FIFO_CHUNK_DATA;
-    header[1] = chunk_length+1;         /* incl flags */
-    header[2] = AX_FIFO_TXDATA_PKTSTART | pkt_end;
-    ax_hw_write_fifo(config, header, 3);
+  tmpl->prefix_length = ptr - tmpl->prefix;
+}
+/**
+ * TXPWR chunk that sets TXPWRCOEFFB to coeffb, with no predistortion.
+ * Returns the chunk length
+ */
+static uint8_t ax_fifo_tx_power_chunk(uint8_t* chunk, uint16_t coeffb)
+{
+  memset(chunk, 0, 12);
+  chunk[0] = AX_FIFO_CHUNK_TXPWR;
+  chunk[1] = 10;                /* TXPWRCOEFFA-E */
+  chunk[4] = (coeffb >> 8);     /* TXPWRCOEFFB */
+  chunk[5] = (coeffb >> 0);
+
+  return 12;
+}
+/**
+ * write tx data
+ *
+ * Each chunk goes to the fifo in one transaction, together with the
+ * power and preamble for the first chunk, and is committed in the same
+ * batch.
+ *
+ * The power chunk is only sent if power_dbm (or mod, for
+ * AX_TX_POWER_MOD) differs from the last power set.
+ */
+void ax_fifo_tx_data(ax_config* config, ax_modulation* mod,
+                     uint8_t* data, uint16_t length, int8_t power_dbm)
+{
+  ax_tx_template* tmpl = &mod->tx_template;
+  ax_tx_stats* stats = &config->state.tx_stats;
+  uint8_t preamble_length;
+  uint8_t txpwr[12];
+  uint8_t txpwr_length = 0;
+  uint16_t coeffb;
+  uint8_t header[4];
+  ax_spi_xfer segment[4];
+  uint16_t fifofree;
+  uint16_t overhead;
+  uint8_t chunk_length;
+  uint16_t rem_length = length;
+  uint8_t pkt_start = AX_FIFO_TXDATA_PKTSTART;
+  uint8_t pkt_end;
+  uint8_t length_byte;
+  uint16_t status;
+
+  if ((stats->packets == 0) && config->time_us) {
+    stats->first_us = config->time_us();
+  }
+
+  if (tmpl->prefix_length == 0) {
+    ax_tx_template_compile(mod); /* not from ax_tx_on */
+  }
+  preamble_length = tmpl->prefix_length;
+
+  /* power */
+  if (power_dbm != AX_TX_POWER_MOD) {
+    coeffb = ax_tx_power_coeffb(config, power_dbm);
   } else {
-    /* include length byte */
-    header[0] = AX_FIFO_CHUNK_DATA;
-    header[1] = 1+chunk_length+1;         /* incl flags */
-    header[2] = AX_FIFO_TXDATA_PKTSTART | pkt_end;
-    header[3] = length+1;       /* incl length byte */
-    ax_hw_write_fifo(config, header, 4);
+    coeffb = tmpl->power_set ? tmpl->power_coeffb : config->state.tx_power_coeffb;
+  }
+  if (coeffb != config->state.tx_power_coeffb) {
+    txpwr_length = ax_fifo_tx_power_chunk(txpwr, coeffb);
+    preamble_length += txpwr_length;
+    config->state.tx_power_coeffb = coeffb;
   }
-  ax_hw_write_fifo(config, data, (uint8_t)chunk_length);
-  data += chunk_length;
-  ax_fifo_commit(config);       /* commit */
 
-  /* write subsequent data */
-  while (rem_length) {
-    if (rem_length > 200) {     /* send 200 bytes */
-      chunk_length = 200; rem_length -= 200;
-    } else {                    /* finish off */
-      chunk_length = rem_length; rem_length = 0;
-      pkt_end = AX_FIFO_TXDATA_PKTEND;
-    }
+  /* can't include length byte if too long */
+  length_byte = tmpl->length_byte && (length < 255);
 
-    /* wait for enough space for chunk */
-    do {
-      fifocount = ax_hw_read_register_16(config, AX_REG_FIFOCOUNT);
-    } while (fifocount > (256 - (chunk_length+10)));
+  /* wait for enough space to contain the preamble and the start of
+   * the packet */
+  fifofree = ax_fifo_wait_free(config, preamble_length + 4 +
+                               MIN(length, AX_FIFO_TX_REFILL));
+  fifofree -= preamble_length;
 
-    /* write chunk */
+  while (1) {
+    /* largest chunk that fits, in the fifo and in one transaction */
+    overhead = (pkt_start && length_byte) ? 4 : 3;
+    chunk_length = MIN(rem_length, fifofree - overhead);
+    chunk_length = MIN(chunk_length,
+                       AX_FIFO_TX_MAX_WRITE - preamble_length - overhead);
+    rem_length -= chunk_length;
+
+    pkt_end = (rem_length == 0) ? AX_FIFO_TXDATA_PKTEND : 0;
+
+    /* chunk header */
     header[0] = AX_FIFO_CHUNK_DATA;
-    header[1] = chunk_length+1;         /* incl flags */
-    header[2] = pkt_end;
-    ax_hw_write_fifo(config, header, 3);
-    ax_hw_write_fifo(config, data, (uint8_t)chunk_length);
+    header[1] = (overhead - 2) + chunk_length; /* incl flags */
+    header[2] = pkt_start | pkt_end;
+    header[3] = length+1;       /* incl length byte, if used */
+
+    /* write chunk */
+    segment[0].data = txpwr;
+    segment[0].length = txpwr_length;
+    segment[1].data = tmpl->prefix;
+    segment[1].length = preamble_length - txpwr_length;
+    segment[2].data = header;
+    segment[2].length = overhead;
+    segment[3].data = data;
+    segment[3].length = chunk_length;
+
+    ax_hw_batch_begin(config);
+    ax_hw_write_fifo_v(config, segment, 4);
+    ax_fifo_commit(config);     /* commit */
+    status = ax_hw_batch_end(config);
     data += chunk_length;
-    ax_fifo_commit(config);       /* commit */
+
+    if (pkt_start && config->time_ns) {
+      config->state.fifo_tx_time_ns = config->time_ns();
+    }
+
+    ax_fifo_tx_check_flags(config, status);
+    stats->fifo_bytes += preamble_length + overhead + chunk_length;
+
+    if (rem_length == 0) {
+      break;                    /* done */
+    }
+    pkt_start = 0;
+    preamble_length = 0;
+    txpwr_length = 0;
+
+    /* wait for space for the next chunk */
+    fifofree = ax_fifo_wait_free(config, 3 + MIN(rem_length, AX_FIFO_TX_REFILL));
+
+    /* the transmitter has run out partway through the packet */
+    if (ax_hw_status_fifo_empty(ax_hw_status(config))) {
+      stats->starved++;
+    }
+  }
+
+  /* statistics */
+  stats->packets++;
+  stats->bytes += length;
+  if (mod->bitrate) {
+    stats->airtime_us += ((uint64_t)(tmpl->prefix_air_bytes + length_byte + length) *
+                          8 * 1000000 * (mod->fec ? 2 : 1)) / mod->bitrate;
+  }
+  if (config->time_us) {
+    stats->wall_us = config->time_us() - stats->first_us;
   }
 }
 /**
- * read rx data
+ * Size of the rx chunk starting at ptr, or 0 if fewer than two bytes
+ * are available and the size can't be known yet
  */
-uint16_t ax_fifo_rx_data(ax_config* config, ax_rx_chunk* chunk)
+static uint16_t ax_fifo_rx_chunk_size(uint8_t* ptr, uint16_t available)
 {
-  uint8_t ptr[3];
-  uint32_t scratch;
-
-  uint16_t fifocount = ax_hw_read_register_16(config, AX_REG_FIFOCOUNT);
-  if (fifocount == 0) {
-    return 0;                   /* nothing to read */
+  if (available == 0) {
+    return 0;
   }
 
-  debug_printf("got something. fifocount = %d\n", fifocount);
+  switch (ptr[0] & 0xE0) {
+    case AX_FIFO_CHUNK_NO_PAYLOAD:  return 1;
+    case AX_FIFO_CHUNK_SINGLE_BYTE: return 2;
+    case AX_FIFO_CHUNK_TWO_BYTE:    return 3;
+    case AX_FIFO_CHUNK_THREE_BYTE:  return 4;
+    case AX_FIFO_CHUNK_VARIABLE:
+      return (available < 2) ? 0 : (2 + ptr[1]);
+    default:
+      return 1;                 /* unknown, skip the header */
+  }
+}
+/**
+ * decode one complete rx chunk from memory
+ */
+static void ax_fifo_rx_parse(ax_rx_chunk* chunk, uint8_t* ptr)
+{
+  uint32_t scratch;
 
-  chunk->chunk_t = ax_hw_read_register_8(config, AX_REG_FIFODATA);
+  chunk->chunk_t = ptr[0];
 
   switch (chunk->chunk_t) {
     case AX_FIFO_CHUNK_DATA:
-      ax_hw_read_register_bytes(config, AX_REG_FIFODATA, ptr, 2);
-
-      chunk->chunk.data.length = ptr[0] - 1; /* not including flags here */
-      chunk->chunk.data.flags  = ptr[1];
-
-      /* read buffer */
-      ax_hw_read_fifo(config,
-                      chunk->chunk.data.data,
-                      chunk->chunk.data.length + 1);
+      /* not including flags here */
+      chunk->chunk.data.length = (ptr[1] > 0) ? (ptr[1] - 1) : 0;
+      chunk->chunk.data.flags  = (ptr[1] > 0) ? ptr[2] : 0;
 
-      return 3 + chunk->chunk.data.length;
+      /* left where it is, the caller copies it to its final place */
+      chunk->chunk.data.data = ptr + 3;
+      break;
       /* RSSI */
     case AX_FIFO_CHUNK_RSSI:
       /* 8-bit register value is always negative */
-      chunk->chunk.rssi = 0xFF00 | ax_hw_read_register_8(config, AX_REG_FIFODATA);
-      return 2;
+      chunk->chunk.rssi = 0xFF00 | ptr[1];
+      break;
       /* FREQOFFS */
     case AX_FIFO_CHUNK_FREQOFFS:
-      chunk->chunk.freqoffs = ax_hw_read_register_16(config, AX_REG_FIFODATA);
-      return 2;
+      chunk->chunk.freqoffs = ((uint16_t)ptr[1] << 8) | ptr[2];
+      break;
       /* ANTRSSI 2 */
     case AX_FIFO_CHUNK_ANTRSSI2:
-      ax_hw_read_register_bytes(config, AX_REG_FIFODATA, ptr, 2);
-
-      chunk->chunk.antrssi2.rssi      = ptr[0];
-      chunk->chunk.antrssi2.bgndnoise = ptr[1];
-      return 3;
+      chunk->chunk.antrssi2.rssi      = ptr[1];
+      chunk->chunk.antrssi2.bgndnoise = ptr[2];
+      break;
       /* TIMER */
     case AX_FIFO_CHUNK_TIMER:
-      chunk->chunk.timer = ax_hw_read_register_24(config, AX_REG_FIFODATA);
-      return 4;
+      chunk->chunk.timer =
+        ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
+      break;
       /* RFFREQOFFS */
     case AX_FIFO_CHUNK_RFFREQOFFS:
-      scratch = ax_hw_read_register_24(config, AX_REG_FIFODATA);
+      scratch = ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
       /* sign extend 24 -> 32 */
       chunk->chunk.rffreqoffs = (scratch & 0x800000) ?
         (0xFF000000 | scratch) : scratch;
-      return 4;
+      break;
       /* DATARATE */
     case AX_FIFO_CHUNK_DATARATE:
-      chunk->chunk.datarate = ax_hw_read_register_24(config, AX_REG_FIFODATA);
-      return 4;
+      chunk->chunk.datarate =
+        ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ptr[3];
+      break;
       /* ANTRSSI3 */
     case AX_FIFO_CHUNK_ANTRSSI3:
-      ax_hw_read_register_bytes(config, AX_REG_FIFODATA, ptr, 3);
-
-      chunk->chunk.antrssi3.ant0rssi  = ptr[0];
-      chunk->chunk.antrssi3.ant1rssi  = ptr[1];
-      chunk->chunk.antrssi3.bgndnoise = ptr[2];
-      return 4;
+      chunk->chunk.antrssi3.ant0rssi  = ptr[1];
+      chunk->chunk.antrssi3.ant1rssi  = ptr[2];
+      chunk->chunk.antrssi3.bgndnoise = ptr[3];
+      break;
       /* default */
     default:
-      return 1;
+      break;
+  }
+}
+/**
+ * Reads everything in the rx fifo into the rx buffer, in one burst.
+ * Any partial chunk left in the buffer is kept.
+ */
+static void ax_fifo_rx_refill(ax_config* config)
+{
+  ax_state* state = &config->state;
+  uint8_t* buffer = state->fifo_rx + 1; /* fifo_rx[0] is spare */
+  uint16_t fifocount;
+  uint8_t saved;
+
+  /* move the partial chunk to the start */
+  state->fifo_rx_length -= state->fifo_rx_offset;
+  memmove(buffer, buffer + state->fifo_rx_offset, state->fifo_rx_length);
+  state->fifo_rx_offset = 0;
+
+  /* FIFOCOUNT only needs reading again once we've read all the bytes
+   * it reported last time */
+  if (state->fifo_rx_count == 0) {
+    state->fifo_rx_count = ax_hw_read_register_16(config, AX_REG_FIFOCOUNT);
+
+    if (ax_hw_status_fifo_overflow(ax_hw_status(config))) {
+      debug_printf("rx fifo overflow!\n");
+      ax_fifo_clear(config);    /* contents are unusable */
+      state->fifo_rx_overflows++;
+      return;
+    }
+  }
+
+  /* limited by the spi transfer length, and space in the buffer */
+  fifocount = MIN(state->fifo_rx_count, 0xFE);
+  fifocount = MIN(fifocount, sizeof(state->fifo_rx) - 1 - state->fifo_rx_length);
+  if (fifocount == 0) {
+    return;                     /* nothing to read */
+  }
+
+  debug_printf("got something. fifocount = %d\n", fifocount);
+
+  if (config->time_ns) { state->fifo_rx_time_ns = config->time_ns(); }
+
+  /* the first byte read back is status, so this overwrites the byte
+   * before where the new data goes. put it back afterwards */
+  saved = buffer[state->fifo_rx_length - 1];
+  ax_hw_read_fifo(config, buffer + state->fifo_rx_length - 1, fifocount + 1);
+  buffer[state->fifo_rx_length - 1] = saved;
+
+  /* the status of the read is from just before it */
+  if (ax_hw_status_fifo_overflow(ax_hw_status(config))) {
+    debug_printf("rx fifo overflow!\n");
+    ax_fifo_clear(config);      /* contents are unusable */
+    state->fifo_rx_overflows++;
+    return;
   }
+
+  state->fifo_rx_length += fifocount;
+  state->fifo_rx_count -= fifocount;
+}
+/**
+ * read rx data
+ *
+ * The payload of a DATA chunk isn't copied: chunk->chunk.data.data
+ * points into the rx buffer, and is only valid until the next call.
+ *
+ * returns the number of bytes consumed from the fifo, or 0 if there
+ * wasn't a complete chunk
+ */
+uint16_t ax_fifo_rx_data(ax_config* config, ax_rx_chunk* chunk)
+{
+  ax_state* state = &config->state;
+  uint8_t* buffer = state->fifo_rx + 1;
+  uint16_t available = state->fifo_rx_length - state->fifo_rx_offset;
+  uint16_t size;
+
+  size = ax_fifo_rx_chunk_size(buffer + state->fifo_rx_offset, available);
+
+  if ((size == 0) || (size > available)) { /* need more from the radio */
+    do {                        /* again if the rest is known to be there */
+      ax_fifo_rx_refill(config);
+
+      available = state->fifo_rx_length - state->fifo_rx_offset;
+      size = ax_fifo_rx_chunk_size(buffer + state->fifo_rx_offset, available);
+    } while (((size == 0) || (size > available)) &&
+             (state->fifo_rx_count > 0));
+
+    if ((size == 0) || (size > available)) {
+      return 0;                 /* no complete chunk yet */
+    }
+  }
+
+  ax_fifo_rx_parse(chunk, buffer + state->fifo_rx_offset);
+  state->fifo_rx_offset += size;
+
+  return size;
 }
 
 /**
@@ -353,6 +686,12 @@ void ax_set_pwrmode(ax_config* config, uint8_t pwrmode)
 {
   config->pwrmode = pwrmode;
   ax_hw_write_register_8(config, AX_REG_PWRMODE, 0x60 | pwrmode); /* TODO R-m-w */
+
+  if (pwrmode == AX_PWRMODE_DEEPSLEEP) {
+    /* register contents are lost in deepsleep */
+    ax_hw_shadow_invalidate(config);
+    config->state.mod = NULL;
+  }
 }
 
 /**
@@ -401,11 +740,11 @@ void ax_set_modulation_parameters(ax_config* config, ax_modulation* mod)
  */
 void ax_set_pin_configuration(ax_config* config)
 {
-  ax_hw_write_register_8(config, AX_REG_PINFUNCSYSCLK, _pinfunc_sysclk);
-  ax_hw_write_register_8(config, AX_REG_PINFUNCDCLK, _pinfunc_dclk);
-  ax_hw_write_register_8(config, AX_REG_PINFUNCDATA, _pinfunc_data);
-  ax_hw_write_register_8(config, AX_REG_PINFUNCANTSEL, _pinfunc_antsel);
-  ax_hw_write_register_8(config, AX_REG_PINFUNCPWRAMP, _pinfunc_pwramp);
+  ax_hw_write_register_8(config, AX_REG_PINFUNCSYSCLK, config->state.pinfunc.sysclk);
+  ax_hw_write_register_8(config, AX_REG_PINFUNCDCLK, config->state.pinfunc.dclk);
+  ax_hw_write_register_8(config, AX_REG_PINFUNCDATA, config->state.pinfunc.data);
+  ax_hw_write_register_8(config, AX_REG_PINFUNCANTSEL, config->state.pinfunc.antsel);
+  ax_hw_write_register_8(config, AX_REG_PINFUNCPWRAMP, config->state.pinfunc.pwramp);
 }
 
 /**
@@ -551,131 +890,143 @@ void ax_set_afsk_rx_parameters(ax_config* config, ax_modulation* mod)
 
   debug_printf("afskspace (rx) %d = 0x%04x\n", space, afskspace);
 
-  /* Detector Bandwidth */
-  ax_hw_write_register_16(config, AX_REG_AFSKCTRL, mod->par.afskshift);
+  /* Detector Bandwidth. AFSKCTRL is a single byte, AMPLFILTER follows it */
+  ax_hw_write_register_8(config, AX_REG_AFSKCTRL, mod->par.afskshift);
 }
 /**
  * 5.15 set receiver parameters
+ *
+ * IFFREQ to FSKDMIN are consecutive, so they are written in one burst
  */
 void ax_set_rx_parameters(ax_config* config, ax_modulation* mod)
 {
+  uint8_t regs[16];
+  uint32_t maxrfoffset;
+  uint8_t length = 12;
+
   /* IF Frequency */
-  ax_hw_write_register_16(config, AX_REG_IFFREQ, mod->par.iffreq);
+  regs[0] = (mod->par.iffreq >> 8);
+  regs[1] = (mod->par.iffreq >> 0);
 
   debug_printf("WRITE IFFREQ %d\n", mod->par.iffreq);
 
   /* Decimation */
-  ax_hw_write_register_8(config, AX_REG_DECIMATION, mod->par.decimation);
+  regs[2] = mod->par.decimation;
 
   /* RX Data Rate */
-  ax_hw_write_register_24(config, AX_REG_RXDATARATE, mod->par.rx_data_rate);
+  regs[3] = (mod->par.rx_data_rate >> 16);
+  regs[4] = (mod->par.rx_data_rate >> 8);
+  regs[5] = (mod->par.rx_data_rate >> 0);
 
   /* Max Data Rate offset */
-  ax_hw_write_register_24(config, AX_REG_MAXDROFFSET, 0x0);
+  regs[6] = 0; regs[7] = 0; regs[8] = 0;
   /* 0. Therefore < 1% */
 
   /* Max RF offset - Correct offset at first LO */
-  ax_hw_write_register_24(config, AX_REG_MAXRFOFFSET,
-                          (AX_MAXRFOFFSET_FREQOFFSCORR_FIRST_LO |
-                           mod->par.max_rf_offset));
+  maxrfoffset = (AX_MAXRFOFFSET_FREQOFFSCORR_FIRST_LO |
+                 mod->par.max_rf_offset);
+  regs[9]  = (maxrfoffset >> 16);
+  regs[10] = (maxrfoffset >> 8);
+  regs[11] = (maxrfoffset >> 0);
 
   /* Maximum deviation of FSK Demodulator */
   switch (mod->modulation & 0xf) {
     case AX_MODULATION_FSK:
     case AX_MODULATION_MSK:
     case AX_MODULATION_AFSK:
-      ax_hw_write_register_16(config, AX_REG_FSKDMAX,  mod->par.fskd & 0xFFFF);
-      ax_hw_write_register_16(config, AX_REG_FSKDMIN, ~mod->par.fskd & 0xFFFF);
+      regs[12] = ( mod->par.fskd >> 8);  /* FSKDMAX */
+      regs[13] = ( mod->par.fskd >> 0);
+      regs[14] = (~mod->par.fskd >> 8);  /* FSKDMIN */
+      regs[15] = (~mod->par.fskd >> 0);
+      length = 16;
       break;
   }
 
+  ax_hw_write_register_bytes(config, AX_REG_IFFREQ, regs, length);
+
   /* Amplitude Lowpass filter */
   ax_hw_write_register_8(config, AX_REG_AMPLFILTER, mod->par.ampl_filter);
 }
 
 /**
  * 5.15.15+ rx parameter sets
+ *
+ * Each set is 16 consecutive registers, written in one burst
  */
 void ax_set_rx_parameter_set(ax_config* config,
                              uint16_t ps, ax_rx_param_set* pars)
 {
-  uint8_t agcgain;
-  uint8_t timegain, drgain;
+  uint8_t regs[16];
 
 
   /* AGC Gain Attack/Decay */
-  agcgain = ((pars->agc_decay & 0xF) << 4) | (pars->agc_attack & 0xF);
-  ax_hw_write_register_8(config, ps + AX_RX_AGCGAIN, agcgain);
+  regs[AX_RX_AGCGAIN] =
+    ((pars->agc_decay & 0xF) << 4) | (pars->agc_attack & 0xF);
 
 
   /* AGC target value */
   /**
    * Always set to 132, which gives target output of 304 from 1023 counts
    */
-  ax_hw_write_register_8(config, ps + AX_RX_AGCTARGET, 0x84);
+  regs[AX_RX_AGCTARGET] = 0x84;
 
 
   /* AGC digital threashold range */
   /**
    * Always set to zero, the analogue ADC always follows immediately
    */
-  ax_hw_write_register_8(config, ps + AX_RX_AGCAHYST, 0x00);
+  regs[AX_RX_AGCAHYST] = 0x00;
 
 
   /* AGC minmax */
   /**
    * Always set to zero, this is probably best.
    */
-  ax_hw_write_register_8(config, ps + AX_RX_AGCMINMAX, 0x00);
+  regs[AX_RX_AGCMINMAX] = 0x00;
 
 
   /* Gain of timing recovery loop */
-  timegain = ax_value_to_mantissa_exp_4_4(pars->time_gain);
-  ax_hw_write_register_8(config, ps + AX_RX_TIMEGAIN, timegain);
+  regs[AX_RX_TIMEGAIN] = ax_value_to_mantissa_exp_4_4(pars->time_gain);
 
 
   /* Gain of datarate recovery loop */
-  drgain = ax_value_to_mantissa_exp_4_4(pars->dr_gain);
-  ax_hw_write_register_8(config, ps + AX_RX_DRGAIN, drgain);
+  regs[AX_RX_DRGAIN] = ax_value_to_mantissa_exp_4_4(pars->dr_gain);
 
 
   /* Gain of phase recovery loop / decimation filter fractional b/w */
-  ax_hw_write_register_8(config, ps + AX_RX_PHASEGAIN,
-                         ((pars->filter_idx & 0x3) << 6) |
-                         (pars->phase_gain & 0xF));
+  regs[AX_RX_PHASEGAIN] =
+    ((pars->filter_idx & 0x3) << 6) | (pars->phase_gain & 0xF);
 
 
   /* Gain of baseband frequency recovery loop */
-  ax_hw_write_register_8(config, ps + AX_RX_FREQUENCYGAINA,
-                         pars->baseband_rg_phase_det);
-  ax_hw_write_register_8(config, ps + AX_RX_FREQUENCYGAINB,
-                         pars->baseband_rg_freq_det);
+  regs[AX_RX_FREQUENCYGAINA] = pars->baseband_rg_phase_det;
+  regs[AX_RX_FREQUENCYGAINB] = pars->baseband_rg_freq_det;
 
 
   /* Gain of RF frequency recovery loop */
-  ax_hw_write_register_8(config, ps + AX_RX_FREQUENCYGAINC,
-                         pars->rffreq_rg_phase_det);
-  ax_hw_write_register_8(config, ps + AX_RX_FREQUENCYGAIND,
-                         pars->rffreq_rg_freq_det);
+  regs[AX_RX_FREQUENCYGAINC] = pars->rffreq_rg_phase_det;
+  regs[AX_RX_FREQUENCYGAIND] = pars->rffreq_rg_freq_det;
 
   /* Amplitude Recovery Loop */
-  ax_hw_write_register_8(config, ps + AX_RX_AMPLITUDEGAIN,
-                         pars->amplflags | pars->amplgain);
+  regs[AX_RX_AMPLITUDEGAIN] = pars->amplflags | pars->amplgain;
 
 
   /* FSK Receiver Frequency Deviation */
-  ax_hw_write_register_16(config, ps + AX_RX_FREQDEV, pars->freq_dev);
+  regs[AX_RX_FREQDEV]   = (pars->freq_dev >> 8);
+  regs[AX_RX_FREQDEV+1] = (pars->freq_dev >> 0);
 
 
   /* TODO FOUR FSK */
-  ax_hw_write_register_8(config, ps + AX_RX_FOURFSK, 0x16);
+  regs[AX_RX_FOURFSK] = 0x16;
 
 
   /* BB Gain Block Offset Compensation Resistors */
   /**
    * Always 0x00
    */
-  ax_hw_write_register_8(config, ps + AX_RX_BBOFFSRES, 0x00);
+  regs[AX_RX_BBOFFSRES] = 0x00;
+
+  ax_hw_write_register_bytes(config, ps, regs, 16);
 }
 
 
@@ -749,9 +1100,12 @@ uint8_t ax_modcfga_tx_parameters_tx_path(enum ax_transmit_path path)
 }
 /**
  * 5.16 set transmitter parameters
+ *
+ * MODCFGF to TXRATE are consecutive, so they are written in one burst
  */
 void ax_set_tx_parameters(ax_config* config, ax_modulation* mod)
 {
+  uint8_t regs[8];
   uint8_t modcfga;
   float p;
   uint16_t pwr;
@@ -759,7 +1113,7 @@ void ax_set_tx_parameters(ax_config* config, ax_modulation* mod)
   uint32_t fskdev, txrate;
 
   /* frequency shaping mode of transmitter */
-  ax_hw_write_register_8(config, AX_REG_MODCFGF, mod->shaping & 0x3);
+  regs[0] = mod->shaping & 0x3; /* MODCFGF */
 
   /* transmit path */
   modcfga = ax_modcfga_tx_parameters_tx_path(config->transmit_path);
@@ -769,7 +1123,7 @@ void ax_set_tx_parameters(ax_config* config, ax_modulation* mod)
       modcfga |= AX_MODCFGA_AMPLSHAPE_RAISED_COSINE;
       break;
   }
-  ax_hw_write_register_8(config, AX_REG_MODCFGA, modcfga);
+  regs[4] = modcfga;            /* MODCFGA */
 
   /* TX deviation */
   switch (mod->modulation & 0xf) {
@@ -794,17 +1148,23 @@ void ax_set_tx_parameters(ax_config* config, ax_modulation* mod)
 
       break;
   }
-  ax_hw_write_register_24(config, AX_REG_FSKDEV, fskdev);
+  regs[1] = (fskdev >> 16);     /* FSKDEV */
+  regs[2] = (fskdev >> 8);
+  regs[3] = (fskdev >> 0);
   debug_printf("fskdev %d = 0x%06x\n", deviation, fskdev);
 
 
   /* TX bitrate. We assume bitrate < f_xtal */
   txrate = (uint32_t)((((float)mod->bitrate * (1 << 24)) /
                        (float)config->f_xtal) + 0.5);
-  ax_hw_write_register_24(config, AX_REG_TXRATE, txrate);
+  regs[5] = (txrate >> 16);     /* TXRATE */
+  regs[6] = (txrate >> 8);
+  regs[7] = (txrate >> 0);
 
   debug_printf("bitrate %d = 0x%06x\n", mod->bitrate, txrate);
 
+  ax_hw_write_register_bytes(config, AX_REG_MODCFGF, regs, 8);
+
   /* check bitrate for asynchronous wire mode */
   if (1 && mod->bitrate >= config->f_xtal / 32) {
     debug_printf("for asynchronous wire mode, bitrate must be less than f_xtal/32\n");
@@ -819,9 +1179,61 @@ void ax_set_tx_parameters(ax_config* config, ax_modulation* mod)
   pwr = (uint16_t)((p * (1 << 12)) + 0.5);
   pwr = (pwr > 0xFFF) ? 0xFFF : pwr; /* max 0xFFF */
   ax_hw_write_register_16(config, AX_REG_TXPWRCOEFFB, pwr);
+  config->state.tx_power_coeffb = pwr;
+
+  /* packets return to this power after ax_tx_packet_power */
+  mod->tx_template.power_coeffb = pwr;
+  mod->tx_template.power_set = 1;
 
   debug_printf("power %f = 0x%03x\n", mod->power, pwr);
 }
+/**
+ * TXPWRCOEFFB for each dBm from AX_TX_POWER_MIN_DBM, assuming output
+ * power follows the square of TXPWRCOEFFB up to the maximum at 0xFFF.
+ * Calibrate on your hardware if it matters.
+ */
+static const uint16_t ax_tx_power_table_diff[] = {
+  0x0cd, 0x0e6, 0x102, 0x122, 0x145, 0x16d, 0x19a, 0x1cb, 0x204, 0x242, /* -10 */
+  0x289, 0x2d8, 0x331, 0x395, 0x405, 0x482, 0x50f, 0x5ad, 0x65e, 0x725, /* 0 */
+  0x804, 0x8ff, 0xa18, 0xb53, 0xcb5, 0xe42, 0xfff,                      /* 10 */
+};
+static const uint16_t ax_tx_power_table_se[] = {
+  0x19a, 0x1cb, 0x204, 0x242, 0x289, 0x2d8, 0x331, 0x395, 0x405, 0x482, /* -10 */
+  0x50f, 0x5ad, 0x65e, 0x725, 0x804, 0x8ff, 0xa18, 0xb53, 0xcb5, 0xe42, /* 0 */
+  0xfff,                                                                /* 10 */
+};
+/**
+ * TXPWRCOEFFB for an output power of power_dbm on the current transmit
+ * path, from a table. Clamped to the range of the table, and to
+ * transmit_power_limit
+ */
+uint16_t ax_tx_power_coeffb(ax_config* config, int8_t power_dbm)
+{
+  const uint16_t* table;
+  int8_t max_dbm;
+  uint16_t pwr, limit;
+
+  if (config->transmit_path == AX_TRANSMIT_PATH_SE) {
+    table = ax_tx_power_table_se;
+    max_dbm = AX_TX_POWER_MAX_DBM_SE;
+  } else {
+    table = ax_tx_power_table_diff;
+    max_dbm = AX_TX_POWER_MAX_DBM_DIFF;
+  }
+
+  if (power_dbm < AX_TX_POWER_MIN_DBM) { power_dbm = AX_TX_POWER_MIN_DBM; }
+  if (power_dbm > max_dbm) { power_dbm = max_dbm; }
+  pwr = table[power_dbm - AX_TX_POWER_MIN_DBM];
+
+  /* TX power limit */
+  if (config->transmit_power_limit > 0) {
+    limit = (uint16_t)((MIN(config->transmit_power_limit, 1) * (1 << 12)) + 0.5);
+    limit = (limit > 0xFFF) ? 0xFFF : limit;
+    pwr = MIN(pwr, limit);
+  }
+
+  return pwr;
+}
 
 /**
  * 5.17 set PLL parameters
@@ -963,7 +1375,8 @@ void ax_set_pattern_match_parameters(ax_config* config, ax_modulation* mod)
                              mod->par.match1_threashold);
 
       /* Match 0 - sync vector */
-      ax_hw_write_register_32(config, AX_REG_MATCH0PAT, 0x55335533);
+      ax_hw_write_register_32(config, AX_REG_MATCH0PAT,
+                              mod->sync_word ? mod->sync_word : AX_TX_SYNC_WORD);
       /* decoded bits, 32-bit pattern */
       ax_hw_write_register_8(config, AX_REG_MATCH0LEN, 0x1F);
       /* signal a match if recevied bitstream matches for more than 28 bits */
@@ -1118,6 +1531,9 @@ void ax_set_performance_tuning(ax_config* config, ax_modulation* mod)
 void ax_set_registers(ax_config* config, ax_modulation* mod,
                       ax_wakeup_config* wakeup_config)
 {
+  /* queue everything, and send it in as few transfers as possible */
+  ax_hw_batch_begin(config);
+
   // MODULATION, ENCODING, FRAMING, FEC
   ax_set_modulation_parameters(config, mod);
 
@@ -1167,6 +1583,12 @@ void ax_set_registers(ax_config* config, ax_modulation* mod,
 
   // 0xFxx
   ax_set_performance_tuning(config, mod);
+
+  ax_hw_batch_end(config);
+
+  /* turnarounds can reuse these, unless they're for wakeup */
+  config->state.mod = wakeup_config ? NULL : mod;
+  memcpy(&config->state.mod_set, mod, sizeof(ax_modulation));
 }
 /**
  * register settings for transmit
@@ -1183,6 +1605,11 @@ void ax_set_registers_tx(ax_config* config, ax_modulation* mod)
     ax_set_afsk_tx_parameters(config, mod);
   }
 
+  /* no rx interrupts while transmitting */
+  if (config->irq_rx) {
+    ax_hw_write_register_16(config, AX_REG_IRQMASK, 0);
+  }
+
   ax_hw_write_register_8(config, 0xF00, 0x0F); /* const */
   ax_hw_write_register_8(config, 0xF18, 0x06); /* ?? */
 }
@@ -1201,6 +1628,13 @@ void ax_set_registers_rx(ax_config* config, ax_modulation* mod)
     ax_set_afsk_rx_parameters(config, mod);
   }
 
+  /* raise the IRQ pin (PINFUNCIRQ reset value) when there's data in
+   * the fifo. it falls again once the fifo has been read */
+  if (config->irq_rx) {
+    ax_hw_write_register_16(config, AX_REG_FIFOTHRESH, config->irq_rx_threshold);
+    ax_hw_write_register_16(config, AX_REG_IRQMASK, AX_IRQMFIFOTHRCNT);
+  }
+
   ax_hw_write_register_8(config, 0xF00, 0x0F); /* const */
   ax_hw_write_register_8(config, 0xF18, 0x02); /* ?? */
 }
@@ -1322,6 +1756,8 @@ enum ax_vco_ranging_result ax_vco_ranging(ax_config* config)
  */
 void ax_default_params(ax_config* config, ax_modulation* mod)
 {
+  ax_hw_trace_call(config, "ax_default_params");
+
   ax_populate_params(config, mod, &mod->par);
 }
 
@@ -1337,6 +1773,8 @@ int ax_adjust_frequency(ax_config* config, uint32_t frequency)
   uint32_t abs_delta_f;
   ax_synthesiser* synth = &config->synthesiser.A;
 
+  ax_hw_trace_call(config, "ax_adjust_frequency");
+
   if (config->pwrmode == AX_PWRMODE_DEEPSLEEP) {
     /* can't do anything in deepsleep */
     while (1);
@@ -1385,6 +1823,8 @@ int ax_force_quick_adjust_frequency(ax_config* config, uint32_t frequency)
 {
   ax_synthesiser* synth = &config->synthesiser.A;
 
+  ax_hw_trace_call(config, "ax_force_quick_adjust_frequency");
+
   /* set new frequency */
   synth->frequency = frequency;
 
@@ -1400,6 +1840,8 @@ int ax_force_quick_adjust_frequency(ax_config* config, uint32_t frequency)
  */
 void ax_tx_on(ax_config* config, ax_modulation* mod)
 {
+  ax_hw_trace_call(config, "ax_tx_on");
+
   if (mod->par.is_params_set != 0x51) {
     debug_printf("mod->par must be set first! call ax_default_params...\n");
     while(1);
@@ -1408,8 +1850,16 @@ void ax_tx_on(ax_config* config, ax_modulation* mod)
   debug_printf("going for transmit...\n");
 
   /* Registers */
+  ax_hw_batch_begin(config);
   ax_set_registers(config, mod, NULL);
   ax_set_registers_tx(config, mod);
+  ax_hw_batch_end(config);
+
+  /* rate the fifo empties at, fec halves it */
+  config->state.tx_byte_rate = mod->bitrate / (mod->fec ? 16 : 8);
+
+  /* preamble and sync word */
+  ax_tx_template_compile(mod);
 
   /* Enable TCXO if used */
   if (config->tcxo_enable) { config->tcxo_enable(); }
@@ -1430,47 +1880,190 @@ void ax_tx_on(ax_config* config, ax_modulation* mod)
   if (config->tcxo_disable) { config->tcxo_disable(); }
 }
 
+/**
+ * Loads packet into the FIFO
+ */
+static void ax_tx_fifo_packet(ax_config* config, ax_modulation* mod,
+                              uint8_t* packet, uint16_t length,
+                              int8_t power_dbm)
+{
+  if (config->pwrmode != AX_PWRMODE_FULLTX) {
+    debug_printf("PWRMODE must be FULLTX before writing to FIFO!\n");
+    return;
+  }
+
+  /* Ensure the SVMODEM bit (POWSTAT) is set high (See 3.1.1). Usually
+   * the status from the last transaction already says so */
+  if (!ax_hw_status_svmodem(ax_hw_status(config))) {
+    while (!(ax_hw_read_register_8(config, AX_REG_POWSTAT) & AX_POWSTAT_SVMODEM));
+  }
+
+  /* Write preamble and packet to the FIFO */
+  ax_fifo_tx_data(config, mod, packet, length, power_dbm);
+
+  debug_printf("packet written to FIFO!\n");
+}
 /**
  * Loads packet into the FIFO for transmission
  */
 void ax_tx_packet(ax_config* config, ax_modulation* mod,
                   uint8_t* packet, uint16_t length)
 {
+  ax_hw_trace_call(config, "ax_tx_packet");
+
+  ax_tx_fifo_packet(config, mod, packet, length, AX_TX_POWER_MOD);
+}
+/**
+ * Loads packet into the FIFO for transmission at power_dbm, see
+ * ax_tx_power_coeffb. The power is set by a command in the FIFO, so
+ * no registers are written. Later packets return to mod's power.
+ */
+void ax_tx_packet_power(ax_config* config, ax_modulation* mod,
+                        uint8_t* packet, uint16_t length, int8_t power_dbm)
+{
+  ax_hw_trace_call(config, "ax_tx_packet_power");
+
+  ax_tx_fifo_packet(config, mod, packet, length, power_dbm);
+}
+/**
+ * Queues a packet for ax_tx_flush. The packet is copied, and will be
+ * sent with mod.
+ *
+ * If the queue is full it is flushed first. Without a queue, or if the
+ * packet is bigger than the whole queue, it is sent at once.
+ */
+void ax_tx_enqueue(ax_config* config, ax_modulation* mod,
+                   uint8_t* packet, uint16_t length)
+{
+  ax_tx_enqueue_power(config, mod, packet, length, AX_TX_POWER_MOD);
+}
+/**
+ * Queues a packet for ax_tx_flush, to be sent at power_dbm
+ */
+void ax_tx_enqueue_power(ax_config* config, ax_modulation* mod,
+                         uint8_t* packet, uint16_t length, int8_t power_dbm)
+{
+  ax_tx_queue* queue = config->tx_queue;
+  ax_tx_queue_entry* entry;
+
+  ax_hw_trace_call(config, "ax_tx_enqueue");
+
+  if (!queue || (length > sizeof(queue->data))) {
+    ax_tx_flush(config);        /* keep order */
+    ax_tx_fifo_packet(config, mod, packet, length, power_dbm);
+    return;
+  }
+
+  /* make room */
+  if ((queue->count == sizeof(queue->packet) / sizeof(ax_tx_queue_entry)) ||
+      ((queue->data_used + length) > sizeof(queue->data))) {
+    ax_tx_flush(config);
+  }
+
+  /* queue */
+  entry = &queue->packet[queue->count];
+  entry->mod = mod;
+  entry->offset = queue->data_used;
+  entry->length = length;
+  entry->power_dbm = power_dbm;
+  memcpy(queue->data + queue->data_used, packet, length);
+  queue->data_used += length;
+  queue->count++;
+}
+/**
+ * Loads all queued packets into the FIFO, back to back. Each packet
+ * is written as soon as there is room for it, so the transmitter
+ * doesn't go idle between them.
+ *
+ * Returns when the last packet is in the FIFO
+ */
+void ax_tx_flush(ax_config* config)
+{
+  ax_tx_queue* queue = config->tx_queue;
+  ax_tx_queue_entry* entry;
+  uint8_t i;
+
+  ax_hw_trace_call(config, "ax_tx_flush");
+
+  if (!queue || (queue->count == 0)) {
+    return;                     /* nothing queued */
+  }
+
   if (config->pwrmode != AX_PWRMODE_FULLTX) {
     debug_printf("PWRMODE must be FULLTX before writing to FIFO!\n");
     return;
   }
 
   /* Ensure the SVMODEM bit (POWSTAT) is set high (See 3.1.1) */
-  while (!(ax_hw_read_register_8(config, AX_REG_POWSTAT) & AX_POWSTAT_SVMODEM));
+  if (!ax_hw_status_svmodem(ax_hw_status(config))) {
+    while (!(ax_hw_read_register_8(config, AX_REG_POWSTAT) & AX_POWSTAT_SVMODEM));
+  }
 
-  /* Write preamble and packet to the FIFO */
-  ax_fifo_tx_data(config, mod, packet, length);
+  for (i = 0; i < queue->count; i++) {
+    entry = &queue->packet[i];
+    ax_fifo_tx_data(config, entry->mod,
+                    queue->data + entry->offset, entry->length,
+                    entry->power_dbm);
+  }
 
-  debug_printf("packet written to FIFO!\n");
+  debug_printf("%d packets written to FIFO!\n", queue->count);
+
+  queue->count = 0;
+  queue->data_used = 0;
 }
 /**
  * Loads 1000 bits-times of zeros into the FIFO for tranmission
  */
 void ax_tx_1k_zeros(ax_config* config)
 {
+  ax_hw_trace_call(config, "ax_tx_1k_zeros");
+
   if (config->pwrmode != AX_PWRMODE_FULLTX) {
     debug_printf("PWRMODE must be FULLTX before writing to FIFO!\n");
     return;
   }
 
-  /* Ensure the SVMODEM bit (POWSTAT) is set high (See 3.1.1) */
-  while (!(ax_hw_read_register_8(config, AX_REG_POWSTAT) & AX_POWSTAT_SVMODEM));
+  /* Ensure the SVMODEM bit (POWSTAT) is set high (See 3.1.1). Usually
+   * the status from the last transaction already says so */
+  if (!ax_hw_status_svmodem(ax_hw_status(config))) {
+    while (!(ax_hw_read_register_8(config, AX_REG_POWSTAT) & AX_POWSTAT_SVMODEM));
+  }
 
   /* Write 1k zeros to fifo */
   ax_fifo_tx_1k_zeros(config);
 }
+/**
+ * Transmits an unframed stream from a producer, without preamble or
+ * packet boundaries. Returns once the producer ends the stream and the
+ * last byte is in the FIFO.
+ *
+ * Underruns, where the FIFO ran empty because the producer fell
+ * behind, are counted in stream->underruns
+ */
+void ax_tx_stream_run(ax_config* config, ax_tx_stream* stream)
+{
+  ax_hw_trace_call(config, "ax_tx_stream_run");
+
+  if (config->pwrmode != AX_PWRMODE_FULLTX) {
+    debug_printf("PWRMODE must be FULLTX before writing to FIFO!\n");
+    return;
+  }
+
+  /* Ensure the SVMODEM bit (POWSTAT) is set high (See 3.1.1) */
+  if (!ax_hw_status_svmodem(ax_hw_status(config))) {
+    while (!(ax_hw_read_register_8(config, AX_REG_POWSTAT) & AX_POWSTAT_SVMODEM));
+  }
+
+  ax_fifo_tx_stream(config, stream);
+}
 
 /**
  * Configure and switch to FULLRX
  */
 void ax_rx_on(ax_config* config, ax_modulation* mod)
 {
+  ax_hw_trace_call(config, "ax_rx_on");
+
   if (mod->par.is_params_set != 0x51) {
     debug_printf("mod->par must be set first! call ax_default_params...\n");
     while(1);
@@ -1478,12 +2071,14 @@ void ax_rx_on(ax_config* config, ax_modulation* mod)
 
   /* Meta-data can be automatically added to FIFO, see PKTSTOREFLAGS */
 
+  ax_hw_batch_begin(config);
   ax_set_registers(config, mod, NULL);
 
   /* Place chip in FULLRX mode */
   ax_set_pwrmode(config, AX_PWRMODE_FULLRX);
 
   ax_set_registers_rx(config, mod);    /* set rx registers */
+  ax_hw_batch_end(config);
 
   /* Enable TCXO if used */
   if (config->tcxo_enable) { config->tcxo_enable(); }
@@ -1501,6 +2096,8 @@ void ax_rx_on(ax_config* config, ax_modulation* mod)
 void ax_rx_wor(ax_config* config, ax_modulation* mod,
                ax_wakeup_config* wakeup_config)
 {
+  ax_hw_trace_call(config, "ax_rx_wor");
+
   if (mod->par.is_params_set != 0x51) {
     debug_printf("mod->par must be set first! call ax_default_params...\n");
     while(1);
@@ -1508,12 +2105,14 @@ void ax_rx_wor(ax_config* config, ax_modulation* mod,
 
   /* Meta-data can be automatically added to FIFO, see PKTSTOREFLAGS */
 
+  ax_hw_batch_begin(config);
   ax_set_registers(config, mod, wakeup_config);
 
   /* Place chip in FULLRX mode */
   ax_set_pwrmode(config, AX_PWRMODE_WORRX);
 
   ax_set_registers_rx(config, mod);    /* set rx registers */
+  ax_hw_batch_end(config);
 
   /* Enable TCXO if used */
   if (config->tcxo_enable) { config->tcxo_enable(); }
@@ -1527,18 +2126,145 @@ void ax_rx_wor(ax_config* config, ax_modulation* mod,
 
 
 /**
- * Reads packets from the FIFO
+ * Returns 1 if the registers are set for mod as it is now. mod may
+ * have been changed in place since, so its settings are compared with
+ * the copy taken when the registers were set
  */
-int ax_rx_packet(ax_config* config, ax_packet* rx_pkt)
+static int ax_registers_set_for(ax_config* config, ax_modulation* mod)
+{
+  return (config->state.mod == mod) &&
+    (memcmp(&config->state.mod_set, mod,
+            offsetof(ax_modulation, tx_template)) == 0);
+}
+/**
+ * Waits for the transmitter to go idle, sleeping between polls if
+ * there's a sleep_us function
+ */
+static void ax_tx_wait_complete(ax_config* config)
+{
+  while (!ax_tx_complete(config)) {
+    if (config->sleep_us) { config->sleep_us(100); }
+  }
+}
+
+/**
+ * Switches from transmit to receive once the transmitter is idle.
+ *
+ * The oscillator and synthesiser keep running, and if the registers
+ * are already set for mod only what differs between
+ * ax_set_registers_tx and ax_set_registers_rx is written, together
+ * with PWRMODE, in one batch. Otherwise this is ax_rx_on.
+ *
+ * Returns the time from the transmitter going idle to the receiver
+ * being on in us, or 0 if there's no config->time_us
+ */
+uint32_t ax_turnaround_rx(ax_config* config, ax_modulation* mod)
+{
+  uint32_t start = 0;
+
+  ax_hw_trace_call(config, "ax_turnaround_rx");
+
+  if ((config->pwrmode != AX_PWRMODE_FULLTX) ||
+      !ax_registers_set_for(config, mod)) {
+    if (config->time_us) { start = config->time_us(); }
+    ax_rx_on(config, mod);
+  } else {
+    /* Send anything still queued, and wait for it to go */
+    ax_tx_flush(config);
+    ax_tx_wait_complete(config);
+
+    if (config->time_us) { start = config->time_us(); }
+
+    ax_hw_batch_begin(config);
+
+    /* Place chip in FULLRX mode */
+    ax_set_pwrmode(config, AX_PWRMODE_FULLRX);
+
+    /* AFSK */
+    if ((mod->modulation & 0xf) == AX_MODULATION_AFSK) {
+      ax_set_afsk_rx_parameters(config, mod);
+    }
+    if (config->irq_rx) {
+      ax_hw_write_register_16(config, AX_REG_FIFOTHRESH, config->irq_rx_threshold);
+      ax_hw_write_register_16(config, AX_REG_IRQMASK, AX_IRQMFIFOTHRCNT);
+    }
+    ax_hw_write_register_8(config, 0xF18, 0x02); /* ?? */
+
+    /* Clear FIFO */
+    ax_fifo_clear(config);
+
+    ax_hw_batch_end(config);
+  }
+
+  config->state.turnaround_us = config->time_us ?
+    (config->time_us() - start) : 0;
+
+  return config->state.turnaround_us;
+}
+/**
+ * Switches from receive to transmit at once. Anything being received
+ * is lost.
+ *
+ * As ax_turnaround_rx, the oscillator keeps running and only the
+ * registers that differ are written. The transmitter waits out the tx
+ * pll settling time itself before it sends from the FIFO.
+ *
+ * Returns the time taken in us, or 0 if there's no config->time_us
+ */
+uint32_t ax_turnaround_tx(ax_config* config, ax_modulation* mod)
+{
+  uint32_t start = 0;
+
+  ax_hw_trace_call(config, "ax_turnaround_tx");
+
+  if (config->time_us) { start = config->time_us(); }
+
+  if ((config->pwrmode != AX_PWRMODE_FULLRX) ||
+      !ax_registers_set_for(config, mod)) {
+    ax_tx_on(config, mod);
+  } else {
+    ax_hw_batch_begin(config);
+
+    /* AFSK */
+    if ((mod->modulation & 0xf) == AX_MODULATION_AFSK) {
+      ax_set_afsk_tx_parameters(config, mod);
+    }
+    /* no rx interrupts while transmitting */
+    if (config->irq_rx) {
+      ax_hw_write_register_16(config, AX_REG_IRQMASK, 0);
+    }
+    ax_hw_write_register_8(config, 0xF18, 0x06); /* ?? */
+
+    /* Clear FIFO */
+    ax_fifo_clear(config);
+
+    /* Place chip in FULLTX mode */
+    ax_set_pwrmode(config, AX_PWRMODE_FULLTX);
+
+    ax_hw_batch_end(config);
+
+    /* rate the fifo empties at, fec halves it */
+    config->state.tx_byte_rate = mod->bitrate / (mod->fec ? 16 : 8);
+
+    /* preamble and sync word */
+    ax_tx_template_compile(mod);
+  }
+
+  config->state.turnaround_us = config->time_us ?
+    (config->time_us() - start) : 0;
+
+  return config->state.turnaround_us;
+}
+
+/**
+ * Reads one packet from the FIFO, for ax_rx_packet(s)
+ */
+static int ax_rx_fifo_packet(ax_config* config, ax_packet* rx_pkt)
 {
   ax_rx_chunk rx_chunk;
+  ax_rx_meta* meta = &config->state.rx_meta;
   uint16_t pkt_wr_index = 0;
   uint16_t length;
-  float offset;
-
-  /* compile parts of the pkt structure, 0x80 is flag for the data itself */
-  uint8_t pkt_parts_list = (config->pkt_store_flags & 0x1E) | 0x80;
-  uint8_t pkt_parts = 0;
 
   while (1) {
     //for (int i = 0; i < 1000*1000*5; i++);
@@ -1559,18 +2285,25 @@ int ax_rx_packet(ax_config* config, ax_packet* rx_pkt)
 
           if ((pkt_wr_index == 0) &&
               !(rx_chunk.chunk.data.flags & AX_FIFO_RXDATA_PKTSTART)) {
-            /* we're trying to start a packet, but that wasn't a packet start */
+            /* we're trying to start a packet, but that wasn't a packet
+             * start. the metadata was for the packet this is part of */
+            memset(meta, 0, sizeof(ax_rx_meta));
             break;              /* discard */
           }
 
           /* if the current chunk would overflow packet data buffer, discard */
           if ((pkt_wr_index + length) > AX_PACKET_MAX_DATA_LENGTH) {
+            memset(meta, 0, sizeof(ax_rx_meta));
             return 0;
           }
 
+          if (pkt_wr_index == 0) {
+            rx_pkt->timestamp_ns = config->state.fifo_rx_time_ns;
+          }
+
           /* copy in this chunk */
           memcpy(rx_pkt->data + pkt_wr_index,
-                 rx_chunk.chunk.data.data + 1, length);
+                 rx_chunk.chunk.data.data, length);
           pkt_wr_index += length;
 
           /* are we done for this packet */
@@ -1588,7 +2321,19 @@ int ax_rx_packet(ax_config* config, ax_packet* rx_pkt)
                            ax_hw_read_register_8(config, AX_REG_FECSTATUS));
             }
 
-            pkt_parts |= 0x80;
+            /* metadata comes ahead of the data, so it's all here. the
+             * next packet's starts afresh */
+            rx_pkt->rssi       = meta->rssi;
+            rx_pkt->rffreqoffs = meta->rffreqoffs;
+            rx_pkt->freqoffs   = meta->freqoffs;
+            rx_pkt->antrssi[0] = meta->antrssi[0];
+            rx_pkt->antrssi[1] = meta->antrssi[1];
+            rx_pkt->bgndnoise  = meta->bgndnoise;
+            rx_pkt->datarate   = meta->datarate;
+            rx_pkt->timer      = meta->timer;
+            memset(meta, 0, sizeof(ax_rx_meta));
+
+            return 1;
           }
 
           break;
@@ -1596,42 +2341,53 @@ int ax_rx_packet(ax_config* config, ax_packet* rx_pkt)
         case AX_FIFO_CHUNK_RSSI:
           debug_printf("rssi %d dB\n", rx_chunk.chunk.rssi);
 
-          rx_pkt->rssi = rx_chunk.chunk.rssi;
-          pkt_parts |= AX_PKT_STORE_RSSI;
+          meta->rssi = rx_chunk.chunk.rssi;
           break;
 
         case AX_FIFO_CHUNK_RFFREQOFFS:
           debug_printf("rf offset %d Hz\n", rx_chunk.chunk.rffreqoffs);
 
-          rx_pkt->rffreqoffs = rx_chunk.chunk.rffreqoffs;
-          pkt_parts |= AX_PKT_STORE_RF_OFFSET;
+          meta->rffreqoffs = rx_chunk.chunk.rffreqoffs;
           break;
 
         case AX_FIFO_CHUNK_FREQOFFS:
-          offset = rx_chunk.chunk.freqoffs * 2000;
-          debug_printf("freq offset %f \n", offset / (1 << 16));
+          debug_printf("freq offset %d\n", rx_chunk.chunk.freqoffs);
 
-          /* todo add data to back */
-          pkt_parts |= AX_PKT_STORE_FREQUENCY_OFFSET;
+          meta->freqoffs = rx_chunk.chunk.freqoffs;
           break;
 
         case AX_FIFO_CHUNK_DATARATE:
-          /* todo process datarate */
+          debug_printf("datarate %d\n", rx_chunk.chunk.datarate);
+
+          meta->datarate = rx_chunk.chunk.datarate;
+          break;
+
+        case AX_FIFO_CHUNK_TIMER:
+          debug_printf("timer %d\n", rx_chunk.chunk.timer);
+
+          meta->timer = rx_chunk.chunk.timer;
+          break;
+
+        case AX_FIFO_CHUNK_ANTRSSI2: /* without diversity */
+          meta->antrssi[0] = rx_chunk.chunk.antrssi2.rssi;
+          meta->antrssi[1] = 0;
+          meta->bgndnoise  = rx_chunk.chunk.antrssi2.bgndnoise;
+          break;
 
-          pkt_parts |= AX_PKT_STORE_DATARATE_OFFSET;
+        case AX_FIFO_CHUNK_ANTRSSI3: /* with diversity */
+          meta->antrssi[0] = rx_chunk.chunk.antrssi3.ant0rssi;
+          meta->antrssi[1] = rx_chunk.chunk.antrssi3.ant1rssi;
+          meta->bgndnoise  = rx_chunk.chunk.antrssi3.bgndnoise;
           break;
+
         default:
 
           debug_printf("some other chunk type 0x%02x\n", rx_chunk.chunk_t);
           break;
       }
-
-      if (pkt_parts == pkt_parts_list) {
-        /* we have all the parts for a packet */
-        return 1;
-      }
     } else if (pkt_wr_index == 0) {
-      /* nothing to read from fifo */
+      /* nothing to read from fifo. metadata read so far is kept for
+       * its packet */
       return 0;
     }
   }
@@ -1639,20 +2395,249 @@ int ax_rx_packet(ax_config* config, ax_packet* rx_pkt)
   /* Disable TCXO if used */
   if (config->tcxo_disable) { config->tcxo_disable(); }
 }
+/**
+ * Reads packets from the FIFO
+ */
+int ax_rx_packet(ax_config* config, ax_packet* rx_pkt)
+{
+  ax_hw_trace_call(config, "ax_rx_packet");
 
+  return ax_rx_fifo_packet(config, rx_pkt);
+}
 /**
- * Waits for any ongoing operations to complete, and then shuts down the radio
+ * Reads up to max packets from the FIFO into out[], waiting up to
+ * timeout_ms for the first if there are none. 0 doesn't wait, and
+ * negative waits forever.
+ *
+ * Waits on the IRQ pin if config->irq_rx is set and there's an
+ * irq_wait function, or otherwise sleeps 1ms at a time with
+ * sleep_us. Failing both, polls the FIFO if there's a time_us
+ * function to time out with.
+ *
+ * Returns the number of packets read
  */
-void ax_off(ax_config* config)
+int ax_rx_packets(ax_config* config, ax_packet* out, size_t max, int timeout_ms)
+{
+  size_t count = 0;
+  uint32_t start = 0, elapsed_ms = 0, wait_ms;
+
+  ax_hw_trace_call(config, "ax_rx_packets");
+
+  if (config->time_us) { start = config->time_us(); }
+
+  while (1) {
+    while ((count < max) && ax_rx_fifo_packet(config, &out[count])) {
+      count++;
+    }
+    if (count || (max == 0) || (timeout_ms == 0)) {
+      break;
+    }
+
+    if (config->time_us) {
+      elapsed_ms = (config->time_us() - start) / 1000;
+    }
+    if ((timeout_ms > 0) && (elapsed_ms >= (uint32_t)timeout_ms)) {
+      break;                    /* timeout */
+    }
+
+    /* wake every 10ms in case the edge is missed */
+    wait_ms = (timeout_ms > 0) ? MIN(timeout_ms - elapsed_ms, 10) : 10;
+
+    if (config->irq_rx && config->irq_wait) { /* interrupt */
+      config->irq_wait(config, wait_ms);
+    } else if (config->sleep_us) { /* sleep */
+      wait_ms = 1;
+      config->sleep_us(1000);
+    } else if (config->time_us) { /* poll */
+      wait_ms = 0;
+    } else {
+      break;                    /* no way to time out */
+    }
+
+    if (!config->time_us) {
+      elapsed_ms += wait_ms;
+    }
+  }
+
+  return count;
+}
+/**
+ * Ends the stream's current frame early, if there is one
+ */
+static void ax_rx_stream_abort(ax_rx_stream* stream)
+{
+  if (stream->in_frame) {
+    stream->in_frame = 0;
+    stream->aborts++;
+    stream->consume(stream, NULL, 0, AX_RX_STREAM_ABORT);
+  }
+}
+/**
+ * Hands every DATA chunk in the FIFO to stream->consume as it is read,
+ * so frames can be longer than AX_PACKET_MAX_DATA_LENGTH. A frame is
+ * aborted if the FIFO overflows partway through, or the radio aborts
+ * it, or another starts before it ends. Returns when the FIFO is empty.
+ *
+ * Returns the number of frames that ended
+ */
+int ax_rx_stream_poll(ax_config* config, ax_rx_stream* stream)
+{
+  ax_rx_chunk rx_chunk;
+  uint32_t overflows = config->state.fifo_rx_overflows;
+  uint16_t got, length;
+  uint8_t flags;
+  int frames = 0;
+
+  ax_hw_trace_call(config, "ax_rx_stream_poll");
+
+  while (1) {
+    got = ax_fifo_rx_data(config, &rx_chunk);
+
+    if (config->state.fifo_rx_overflows != overflows) {
+      /* the rest of the frame is gone */
+      overflows = config->state.fifo_rx_overflows;
+      ax_rx_stream_abort(stream);
+    }
+    if (!got) {
+      break;                    /* fifo empty */
+    }
+
+    switch (rx_chunk.chunk_t) {
+      case AX_FIFO_CHUNK_DATA:
+        length = rx_chunk.chunk.data.length;
+        stream->rx_flags = rx_chunk.chunk.data.flags;
+        flags = 0;
+
+        if (stream->rx_flags & AX_FIFO_RXDATA_PKTSTART) {
+          ax_rx_stream_abort(stream); /* last one never ended */
+          stream->in_frame = 1;
+          stream->length = 0;
+          stream->timestamp_ns = config->state.fifo_rx_time_ns;
+          flags |= AX_RX_STREAM_START;
+        } else if (!stream->in_frame) {
+          break;                /* missed the start, discard */
+        }
+
+        if (stream->rx_flags & AX_FIFO_RXDATA_ABORT) {
+          ax_rx_stream_abort(stream);
+          break;
+        }
+        if (stream->rx_flags & AX_FIFO_RXDATA_PKTEND) {
+          flags |= AX_RX_STREAM_END;
+          stream->in_frame = 0;
+          stream->frames++;
+          frames++;
+        }
+
+        stream->length += length;
+        stream->bytes += length;
+        stream->consume(stream, rx_chunk.chunk.data.data, length, flags);
+        break;
+
+      case AX_FIFO_CHUNK_RSSI:
+        stream->rssi = rx_chunk.chunk.rssi;
+        break;
+
+      case AX_FIFO_CHUNK_RFFREQOFFS:
+        stream->rffreqoffs = rx_chunk.chunk.rffreqoffs;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  return frames;
+}
+/**
+ * consume for ax_rx_stream, that reassembles frames into the
+ * ax_rx_frame in stream->context
+ */
+void ax_rx_frame_consume(ax_rx_stream* stream, uint8_t* data, uint16_t length,
+                         uint8_t flags)
+{
+  ax_rx_frame* frame = stream->context;
+
+  if (flags & (AX_RX_STREAM_START | AX_RX_STREAM_ABORT)) {
+    frame->length = 0;
+    frame->dropping = 0;
+  }
+  if ((flags & AX_RX_STREAM_ABORT) || frame->dropping) {
+    return;
+  }
+
+  if ((frame->length + length) > frame->size) {
+    if (!frame->grow || frame->grow(frame, frame->length + length) ||
+        ((frame->length + length) > frame->size)) {
+      frame->dropping = 1;      /* until the next start */
+      frame->too_long++;
+      return;
+    }
+  }
+
+  memcpy(frame->data + frame->length, data, length);
+  frame->length += length;
+
+  if ((flags & AX_RX_STREAM_END) && frame->complete) {
+    frame->complete(frame, stream);
+  }
+}
+
+/**
+ * Returns 1 if the transmitter has sent everything and is idle, by
+ * reading RADIOSTATE
+ */
+int ax_tx_complete(ax_config* config)
 {
-  /* Wait for ongoing transmit to complete by polling RADIOSTATE */
   uint8_t radiostate;
 
-  do {
-    radiostate = ax_hw_read_register_8(config, AX_REG_RADIOSTATE) & 0xF;
-  } while ((radiostate == AX_RADIOSTATE_TX_PLL_SETTLING) ||
+  radiostate = ax_hw_read_register_8(config, AX_REG_RADIOSTATE) & 0xF;
+
+  return !((radiostate == AX_RADIOSTATE_TX_PLL_SETTLING) ||
            (radiostate == AX_RADIOSTATE_TX) ||
            (radiostate == AX_RADIOSTATE_TX_TAIL));
+}
+
+/**
+ * Returns the running total of bytes written to the fifo that have
+ * since left it. Bytes removed by clearing the fifo count as sent
+ */
+uint32_t ax_tx_fifo_sent(ax_config* config)
+{
+  return config->state.fifo_tx_written -
+    ax_hw_read_register_16(config, AX_REG_FIFOCOUNT);
+}
+
+/**
+ * Copies the transmit statistics into stats
+ */
+void ax_tx_stats_get(ax_config* config, ax_tx_stats* stats)
+{
+  memcpy(stats, &config->state.tx_stats, sizeof(ax_tx_stats));
+}
+/**
+ * Clears the transmit statistics
+ */
+void ax_tx_stats_clear(ax_config* config)
+{
+  memset(&config->state.tx_stats, 0, sizeof(ax_tx_stats));
+  config->state.tx_stats.fifofree_min = 0xFFFF;
+}
+
+/**
+ * Waits for any ongoing operations to complete, and then shuts down the radio
+ */
+void ax_off(ax_config* config)
+{
+  ax_hw_trace_call(config, "ax_off");
+
+  /* Send anything still queued */
+  if (config->pwrmode == AX_PWRMODE_FULLTX) {
+    ax_tx_flush(config);
+  }
+
+  /* Wait for ongoing transmit to complete by polling RADIOSTATE */
+  while (!ax_tx_complete(config));
 
   ax_set_pwrmode(config, AX_PWRMODE_POWERDOWN);
 
@@ -1664,6 +2649,8 @@ void ax_off(ax_config* config)
  */
 void ax_force_off(ax_config* config)
 {
+  ax_hw_trace_call(config, "ax_force_off");
+
   ax_set_pwrmode(config, AX_PWRMODE_POWERDOWN);
 }
 
@@ -1673,34 +2660,41 @@ void ax_force_off(ax_config* config)
  */
 void ax_set_pinfunc_sysclk(ax_config* config, pinfunc_t func)
 {
-  _pinfunc_sysclk = func;
-  ax_hw_write_register_8(config, AX_REG_PINFUNCSYSCLK, _pinfunc_sysclk);
+  config->state.pinfunc.sysclk = func;
+  config->state.pinfunc.set |= AX_PINFUNC_SYSCLK;
+  ax_hw_write_register_8(config, AX_REG_PINFUNCSYSCLK, config->state.pinfunc.sysclk);
 }
 void ax_set_pinfunc_dclk(ax_config* config, pinfunc_t func)
 {
-  _pinfunc_dclk = func;
-  ax_hw_write_register_8(config, AX_REG_PINFUNCDCLK, _pinfunc_dclk);
+  config->state.pinfunc.dclk = func;
+  config->state.pinfunc.set |= AX_PINFUNC_DCLK;
+  ax_hw_write_register_8(config, AX_REG_PINFUNCDCLK, config->state.pinfunc.dclk);
 }
 void ax_set_pinfunc_data(ax_config* config, pinfunc_t func)
 {
-  _pinfunc_data = func;
-  ax_hw_write_register_8(config, AX_REG_PINFUNCDATA, _pinfunc_data);
+  config->state.pinfunc.data = func;
+  config->state.pinfunc.set |= AX_PINFUNC_DATA;
+  ax_hw_write_register_8(config, AX_REG_PINFUNCDATA, config->state.pinfunc.data);
 }
 void ax_set_pinfunc_antsel(ax_config* config, pinfunc_t func)
 {
-  _pinfunc_antsel = func;
-  ax_hw_write_register_8(config, AX_REG_PINFUNCANTSEL, _pinfunc_antsel);
+  config->state.pinfunc.antsel = func;
+  config->state.pinfunc.set |= AX_PINFUNC_ANTSEL;
+  ax_hw_write_register_8(config, AX_REG_PINFUNCANTSEL, config->state.pinfunc.antsel);
 }
 void ax_set_pinfunc_pwramp(ax_config* config, pinfunc_t func)
 {
-  _pinfunc_pwramp = func;
-  ax_hw_write_register_8(config, AX_REG_PINFUNCPWRAMP, _pinfunc_pwramp);
+  config->state.pinfunc.pwramp = func;
+  config->state.pinfunc.set |= AX_PINFUNC_PWRAMP;
+  ax_hw_write_register_8(config, AX_REG_PINFUNCPWRAMP, config->state.pinfunc.pwramp);
 }
 /**
  * immediately updates tx path
  */
 void ax_set_tx_path(ax_config* config, enum ax_transmit_path path)
 {
+  ax_hw_trace_call(config, "ax_set_tx_path");
+
   config->transmit_path = path;
 
   uint8_t modcfga = ax_hw_read_register_8(config, AX_REG_MODCFGA);
@@ -1718,9 +2712,34 @@ void ax_set_tx_path(ax_config* config, enum ax_transmit_path path)
  */
 int ax_init(ax_config* config)
 {
+  ax_pinfunc pinfunc;
+
+  ax_hw_trace_call(config, "ax_init");
+
+  /* we don't know anything about the register contents yet */
+  ax_hw_shadow_invalidate(config);
+
+  /* driver state, keeping any pin functions already set */
+  pinfunc = config->state.pinfunc;
+  memset(&config->state, 0, sizeof(ax_state));
+  config->state.pinfunc.sysclk =
+    (pinfunc.set & AX_PINFUNC_SYSCLK) ? pinfunc.sysclk : 1;
+  config->state.pinfunc.dclk =
+    (pinfunc.set & AX_PINFUNC_DCLK)   ? pinfunc.dclk   : 1;
+  config->state.pinfunc.data =
+    (pinfunc.set & AX_PINFUNC_DATA)   ? pinfunc.data   : 1;
+  config->state.pinfunc.antsel =
+    (pinfunc.set & AX_PINFUNC_ANTSEL) ? pinfunc.antsel : 1;
+  config->state.pinfunc.pwramp =
+    (pinfunc.set & AX_PINFUNC_PWRAMP) ? pinfunc.pwramp : 7;
+  config->state.pinfunc.set = pinfunc.set;
+  config->state.tx_power_coeffb = 0xFFF; /* reset value */
+  config->state.tx_stats.fifofree_min = 0xFFFF;
+
 #ifndef _AX_DUMMY
-  /* must set spi_transfer */
-  if (!config->spi_transfer) {
+  /* must set spi_transfer, unless replaying a trace */
+  if (!config->spi_transfer &&
+      !(config->trace && config->trace->transfer)) {
     return AX_INIT_SET_SPI;
   }
 
@@ -1748,6 +2767,7 @@ int ax_init(ax_config* config)
 
   /* Set RST bit (PWRMODE) */
   ax_hw_write_register_8(config, AX_REG_PWRMODE, AX_PWRMODE_RST);
+  ax_hw_shadow_invalidate(config); /* registers now have reset values */
 
   /* Set the PWRMODE register to POWERDOWN, also clears RST bit */
   ax_set_pwrmode(config, AX_PWRMODE_POWERDOWN);
@@ -108,6 +108,19 @@ typedef struct ax_params {
 
 } ax_params;
 
+/**
+ * Bytes that start every transmitted packet, compiled from an
+ * ax_modulation by ax_tx_on
+ */
+typedef struct ax_tx_template {
+  uint8_t prefix[0x10];         /* preamble and sync word fifo chunks */
+  uint8_t prefix_length;        /* 0 = not compiled yet */
+  uint8_t length_byte;          /* 1 = packets start with a length byte */
+  uint8_t prefix_air_bytes;     /* bytes the prefix sends over the air */
+  uint16_t power_coeffb;        /* TXPWRCOEFFB for power */
+  uint8_t power_set;            /* 1 = power_coeffb is set */
+} ax_tx_template;
+
 /**
  * Represents the chosen modulation scheme.
  */
@@ -126,6 +139,10 @@ typedef struct ax_modulation {
 
   uint8_t fixed_packet_length;  /* 0 = variable length, 1-255 = length */
 
+  /* tx preamble and sync word, 0 for the defaults */
+  uint8_t preamble_length;      /* bytes of 0xAA, or HDLC flags */
+  uint32_t sync_word;           /* as MATCH0PAT, bits 7:0 sent first */
+
   union {
     struct {                    /* FSK */
       float modulation_index;
@@ -140,6 +157,7 @@ typedef struct ax_modulation {
   /* larger increases the time for the AFC to achieve lock */
 
   ax_params par;                /* tweakable parameters */
+  ax_tx_template tx_template;   /* set by ax_tx_on */
 
 } ax_modulation;
 
@@ -169,6 +187,12 @@ enum ax_transmit_path {
   AX_TRANSMIT_PATH_DIFF = 0,
   AX_TRANSMIT_PATH_SE,
 };
+/* Range of ax_tx_power_coeffb, dBm */
+#define AX_TX_POWER_MIN_DBM		-10
+#define AX_TX_POWER_MAX_DBM_DIFF	16
+#define AX_TX_POWER_MAX_DBM_SE		10
+/* power_dbm for packets sent at the modulation's power */
+#define AX_TX_POWER_MOD			-128
 
 
 /**
@@ -190,9 +214,215 @@ typedef struct ax_synthesiser {
 typedef struct ax_packet {
   unsigned char data[0x200];
   uint16_t length;
+  /* metadata, filled in if asked for in config->pkt_store_flags */
+  int16_t rssi;                 /* RSSI, dB */
+  int32_t rffreqoffs;           /* RF_OFFSET, RFFREQ units */
+  int16_t freqoffs;             /* FREQUENCY_OFFSET, bitrate / 2^16 Hz */
+  int8_t antrssi[2];            /* RSSI_ON_ANTENNA_SELECT, per antenna */
+  int8_t bgndnoise;             /* RSSI_ON_ANTENNA_SELECT background noise */
+  uint32_t datarate;            /* DATARATE_OFFSET, TRKDATARATE units */
+  uint32_t timer;               /* TIMER, 24-bit radio timer */
+  /* config->time_ns when the start of the packet was read */
+  uint64_t timestamp_ns;
+} ax_packet;
+
+/**
+ * Metadata chunks read ahead of their packet's data, kept between
+ * calls to ax_rx_packet
+ */
+typedef struct ax_rx_meta {
   int16_t rssi;
   int32_t rffreqoffs;
-} ax_packet;
+  int16_t freqoffs;
+  int8_t antrssi[2];
+  int8_t bgndnoise;
+  uint32_t datarate;
+  uint32_t timer;
+} ax_rx_meta;
+
+/* Where an ax_rx_stream chunk is in its frame. 0 for the middle */
+#define AX_RX_STREAM_START	(1 << 0)
+#define AX_RX_STREAM_END	(1 << 1)
+#define AX_RX_STREAM_ABORT	(1 << 2) /* discard the frame so far */
+
+/**
+ * Sink for frames of any length, for ax_rx_stream_poll
+ */
+typedef struct ax_rx_stream {
+  /* called with each DATA chunk as it arrives. flags are
+   * AX_RX_STREAM_*. there's no data with an abort */
+  void (*consume)(struct ax_rx_stream*, uint8_t* data, uint16_t length,
+                  uint8_t flags);
+  void* context;                /* for use by consume */
+  uint8_t rx_flags;             /* AX_FIFO_RXDATA_* of the last chunk */
+  uint8_t in_frame;             /* 1 = between a start and an end */
+  uint32_t length;              /* of the current frame so far */
+  /* latest metadata, if asked for in config->pkt_store_flags */
+  int16_t rssi;
+  int32_t rffreqoffs;
+  uint64_t timestamp_ns;        /* of the current frame's start */
+  uint32_t frames;              /* running totals */
+  uint32_t bytes;
+  uint32_t aborts;
+} ax_rx_stream;
+
+/**
+ * Reassembles ax_rx_stream chunks into a caller's buffer. Set
+ * stream->consume to ax_rx_frame_consume and stream->context to this
+ */
+typedef struct ax_rx_frame {
+  uint8_t* data;
+  uint32_t size;                /* of data */
+  uint32_t length;              /* bytes in data */
+  /* makes data hold at least size bytes, updating data and size.
+   * returns 0 on success. optional, frames that don't fit abort */
+  int (*grow)(struct ax_rx_frame*, uint32_t size);
+  /* called with each complete frame, in data[0:length] */
+  void (*complete)(struct ax_rx_frame*, ax_rx_stream*);
+  void* context;                /* for use by grow and complete */
+  uint8_t dropping;             /* 1 = the current frame didn't fit */
+  uint32_t too_long;            /* frames that didn't fit */
+} ax_rx_frame;
+
+/**
+ * Shadow copy of the register map, used to skip writes that wouldn't
+ * change the value already in the radio
+ */
+typedef struct ax_shadow {
+  uint8_t value[0x1000];        /* last value written to each register */
+  uint8_t valid[0x200];         /* bitmap, set if value[] is known */
+  uint32_t hits;                /* writes skipped */
+  uint32_t misses;              /* writes sent to the radio */
+} ax_shadow;
+
+/**
+ * One transaction in a vectored spi transfer
+ */
+typedef struct ax_spi_xfer {
+  unsigned char* data;
+  uint8_t length;
+} ax_spi_xfer;
+
+/* most transactions spi_transfer_v is given at once */
+#define AX_BATCH_XFERS	0x40
+
+/**
+ * Writes queued between ax_hw_batch_begin and ax_hw_batch_end
+ */
+typedef struct ax_batch {
+  unsigned char arena[0x200];   /* transaction data */
+  ax_spi_xfer xfer[AX_BATCH_XFERS]; /* transactions */
+  uint16_t arena_used;
+  uint8_t count;                /* number of queued transactions */
+  uint8_t depth;                /* nesting of ax_hw_batch_begin */
+} ax_batch;
+
+/**
+ * SPI transaction trace
+ */
+typedef struct ax_trace {
+  /* called after every transaction with the bytes sent and returned */
+  void (*record)(struct ax_trace*, unsigned char* sent,
+                 unsigned char* received, uint8_t length);
+  /* called on entry to each public API function. optional */
+  void (*call)(struct ax_trace*, const char* name);
+  /* answers each transaction in place of spi_transfer, to replay a
+   * log. optional */
+  void (*transfer)(struct ax_trace*, unsigned char* data, uint8_t length);
+  void* context;                /* for use by record, call and transfer */
+  uint32_t transactions;        /* running totals */
+  uint32_t bytes;
+} ax_trace;
+
+/**
+ * Source of unframed data for ax_tx_stream_run
+ */
+typedef struct ax_tx_stream {
+  /* copies up to length bytes to buffer. returns the number of bytes,
+   * 0 if none are ready yet, or -1 to end the stream */
+  int32_t (*produce)(struct ax_tx_stream*, uint8_t* buffer, uint16_t length);
+  /* called when the fifo has run empty mid-stream. optional */
+  void (*underrun)(struct ax_tx_stream*);
+  void* context;                /* for use by produce and underrun */
+  uint8_t unencoded;            /* 1 = also bypass the encoder */
+  uint32_t bytes;               /* running totals */
+  uint32_t underruns;
+} ax_tx_stream;
+
+/**
+ * Packets waiting in an ax_tx_queue
+ */
+typedef struct ax_tx_queue_entry {
+  ax_modulation* mod;
+  uint16_t offset;              /* into data */
+  uint16_t length;
+  int8_t power_dbm;             /* or AX_TX_POWER_MOD */
+} ax_tx_queue_entry;
+
+/**
+ * Packets queued by ax_tx_enqueue, to be sent back to back by ax_tx_flush
+ */
+typedef struct ax_tx_queue {
+  uint8_t data[0x1000];         /* packet data */
+  ax_tx_queue_entry packet[0x20];
+  uint16_t data_used;
+  uint8_t count;                /* number of queued packets */
+} ax_tx_queue;
+
+/**
+ * Transmit statistics, kept since ax_init or ax_tx_stats_clear. Times
+ * need config->time_us
+ */
+typedef struct ax_tx_stats {
+  uint32_t packets;             /* packets written to the fifo */
+  uint32_t bytes;               /* packet and stream data written */
+  uint32_t fifo_bytes;          /* everything written, incl chunk headers */
+  uint32_t waits;               /* times the fifo didn't have room */
+  uint32_t wait_us;             /* time spent waiting for room */
+  uint16_t fifofree_min;        /* least free space seen, 0xFFFF if none */
+  uint32_t starved;             /* fifo was empty partway through a packet */
+  uint32_t underruns;           /* FIFOSTAT underflow flags */
+  uint32_t overruns;            /* FIFOSTAT overflow flags */
+  uint32_t airtime_us;          /* time on air for packets, at mod->bitrate */
+  uint32_t wall_us;             /* from the first packet write to the last */
+  uint32_t first_us;            /* time_us of the first packet write */
+} ax_tx_stats;
+
+/**
+ * Pin functions, for ax_state
+ */
+typedef struct ax_pinfunc {
+  pinfunc_t sysclk;
+  pinfunc_t dclk;
+  pinfunc_t data;
+  pinfunc_t antsel;
+  pinfunc_t pwramp;
+  uint8_t set;                  /* bitmask of those set by ax_set_pinfunc_* */
+} ax_pinfunc;
+
+/**
+ * Per-radio driver state, managed internally. ax_init clears it all,
+ * except for pin functions that have already been set
+ */
+typedef struct ax_state {
+  uint16_t status;              /* status from the last transaction */
+  uint8_t fifo_rx[0x200];       /* bytes read from the rx fifo */
+  uint16_t fifo_rx_offset;      /* start of the next chunk in fifo_rx */
+  uint16_t fifo_rx_length;      /* bytes in fifo_rx */
+  uint16_t fifo_rx_count;       /* bytes the last FIFOCOUNT says are still in the rx fifo */
+  uint32_t fifo_rx_overflows;   /* times the rx fifo overflowed and was cleared */
+  uint64_t fifo_rx_time_ns;     /* time_ns of the last read from the rx fifo */
+  ax_rx_meta rx_meta;           /* metadata for the next packet to end */
+  uint32_t tx_byte_rate;        /* bytes per second, set by ax_tx_on */
+  uint32_t fifo_tx_written;     /* running total of bytes written to the fifo */
+  uint64_t fifo_tx_time_ns;     /* time_ns when the last packet's first chunk was written */
+  uint16_t tx_power_coeffb;     /* TXPWRCOEFFB, as last set by register or fifo */
+  ax_modulation* mod;           /* registers are set for this, NULL if unknown */
+  ax_modulation mod_set;        /* copy of *mod when its registers were set */
+  uint32_t turnaround_us;       /* time taken by the last turnaround */
+  ax_tx_stats tx_stats;         /* see ax_tx_stats */
+  ax_pinfunc pinfunc;
+} ax_state;
 
 /**
  * configuration
@@ -222,6 +452,20 @@ typedef struct ax_config {
 
   /* spi transfer */
   void (*spi_transfer)(unsigned char*, uint8_t);
+  /* vectored spi transfer. optional, performs each transaction in turn
+   * with chip select released in between */
+  void (*spi_transfer_v)(ax_spi_xfer*, uint8_t);
+  ax_batch batch;               /* queued writes, managed internally */
+
+  /* register shadow. optional, NULL to always write registers */
+  ax_shadow* shadow;
+
+  /* spi trace. optional, NULL to not trace */
+  ax_trace* trace;
+
+  /* transmit queue. optional, NULL to send each packet as it is
+   * enqueued */
+  ax_tx_queue* tx_queue;
 
   /* receive */
   uint8_t pkt_store_flags;      /* PKTSTOREFLAGS */
@@ -229,6 +473,21 @@ typedef struct ax_config {
   /* Note that we always accept multiple chunks (LRGP), bad address
    * (ADDRF), and nonintegral number of bytes in HDLC (RESIDUE) */
 
+  /* interrupts */
+  uint8_t irq_rx;               /* 1 = IRQ pin is raised when rx data waits */
+  uint16_t irq_rx_threshold;    /* raised when FIFOCOUNT exceeds this */
+  /* wait for the IRQ pin to rise, or timeout. optional, used while
+   * waiting for space in the tx fifo */
+  void (*irq_wait)(struct ax_config*, uint32_t timeout_ms);
+  void* irq_context;            /* for use by irq_wait */
+  /* sleep. optional, used while waiting for space in the tx fifo if
+   * there's no irq_wait */
+  void (*sleep_us)(uint32_t us);
+  /* monotonic clock. optional, used to time turnarounds */
+  uint32_t (*time_us)(void);
+  /* monotonic clock. optional, used to timestamp received packets */
+  uint64_t (*time_ns)(void);
+
   /* wakeup */
   uint32_t wakeup_period_ms;
   uint32_t wakeup_xo_early_ms;
@@ -239,6 +498,9 @@ typedef struct ax_config {
   /* pll vco */
   uint32_t f_pllrng;
 
+  /* driver state, set by ax_init */
+  ax_state state;
+
 } ax_config;
 
 /**
@@ -270,13 +532,34 @@ int ax_force_quick_adjust_frequency(ax_config* config, uint32_t frequency);
 void ax_tx_on(ax_config* config, ax_modulation* mod);
 void ax_tx_packet(ax_config* config, ax_modulation* mod,
                   uint8_t* packet, uint16_t length);
+void ax_tx_packet_power(ax_config* config, ax_modulation* mod,
+                        uint8_t* packet, uint16_t length, int8_t power_dbm);
+void ax_tx_enqueue(ax_config* config, ax_modulation* mod,
+                   uint8_t* packet, uint16_t length);
+void ax_tx_enqueue_power(ax_config* config, ax_modulation* mod,
+                         uint8_t* packet, uint16_t length, int8_t power_dbm);
+uint16_t ax_tx_power_coeffb(ax_config* config, int8_t power_dbm);
+void ax_tx_flush(ax_config* config);
 void ax_tx_1k_zeros(ax_config* config);
+void ax_tx_stream_run(ax_config* config, ax_tx_stream* stream);
+int ax_tx_complete(ax_config* config);
+uint32_t ax_tx_fifo_sent(ax_config* config);
+void ax_tx_stats_get(ax_config* config, ax_tx_stats* stats);
+void ax_tx_stats_clear(ax_config* config);
 
 /* receive */
 void ax_rx_on(ax_config* config, ax_modulation* mod);
 void ax_rx_wor(ax_config* config, ax_modulation* mod,
                ax_wakeup_config* wakeup_config);
 int ax_rx_packet(ax_config* config, ax_packet* rx_pkt);
+int ax_rx_packets(ax_config* config, ax_packet* out, size_t max, int timeout_ms);
+int ax_rx_stream_poll(ax_config* config, ax_rx_stream* stream);
+void ax_rx_frame_consume(ax_rx_stream* stream, uint8_t* data, uint16_t length,
+                         uint8_t flags);
+
+/* switch direction, keeping the synthesiser running */
+uint32_t ax_turnaround_rx(ax_config* config, ax_modulation* mod);
+uint32_t ax_turnaround_tx(ax_config* config, ax_modulation* mod);
 
 /* turn off */
 void ax_off(ax_config* config);
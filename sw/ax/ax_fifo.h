@@ -62,10 +62,10 @@ typedef struct ax_rx_chunk {
     struct {
       uint8_t flags;
       uint16_t length;
-      uint8_t data[0x100];
+      uint8_t* data;            /* in the rx buffer, until the next read */
     } data;
     int16_t rssi;
-    uint16_t freqoffs;
+    int16_t freqoffs;
     struct {
       uint8_t rssi;
       uint8_t bgndnoise;
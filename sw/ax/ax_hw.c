@@ -31,10 +31,285 @@
 #include "ax/ax.h"
 #include "ax/ax_hw.h"
 #include "ax/ax_reg.h"
+#include "ax/ax_reg_values.h"
 #include "ax/ax_fifo.h"
 
-/* Current status */
-uint16_t status = 0;
+
+/**
+ * SHADOW ------------------------------------------------
+ */
+
+/**
+ * Registers that the radio changes by itself, or where writing has a
+ * side-effect. These are always written.
+ */
+static int ax_hw_shadow_is_volatile(uint16_t reg)
+{
+  switch (reg) {
+    case AX_REG_PWRMODE:
+    case AX_REG_FIFOSTAT:
+    case AX_REG_FIFODATA:
+    case AX_REG_PLLRANGINGA:
+    case AX_REG_PLLRANGINGB:
+      return 1;
+    default:
+      return 0;
+  }
+}
+/**
+ * Checks bytes about to be written to consecutive registers against
+ * the shadow, and updates the shadow with the new values.
+ *
+ * Returns 1 if the write can be skipped
+ */
+static int ax_hw_shadow_hit(ax_config* config, uint16_t reg,
+                            uint8_t* ptr, uint8_t bytes)
+{
+  ax_shadow* shadow = config->shadow;
+  uint16_t r;
+  uint8_t i;
+  int hit = 1;
+
+  if (!shadow) {
+    return 0;                   /* no shadow */
+  }
+
+  for (i = 0; i < bytes; i++) {
+    r = (reg + i) & 0xFFF;
+
+    if (ax_hw_shadow_is_volatile(r)) {
+      return 0;                 /* write-through, don't count */
+    }
+    if (!(shadow->valid[r >> 3] & (1 << (r & 7))) ||
+        (shadow->value[r] != ptr[i])) {
+      hit = 0;
+    }
+  }
+
+  if (hit) {
+    shadow->hits++;
+    return 1;
+  }
+
+  /* update shadow */
+  for (i = 0; i < bytes; i++) {
+    r = (reg + i) & 0xFFF;
+
+    shadow->value[r] = ptr[i];
+    shadow->valid[r >> 3] |= (1 << (r & 7));
+  }
+  shadow->misses++;
+
+  return 0;
+}
+/**
+ * Forgets all values in the shadow. Call this whenever the radio might
+ * have lost its register contents (reset, deepsleep)
+ */
+void ax_hw_shadow_invalidate(ax_config* config)
+{
+  if (config->shadow) {
+    memset(config->shadow->valid, 0, sizeof(config->shadow->valid));
+  }
+}
+
+
+/**
+ * TRANSFER ----------------------------------------------
+ */
+
+/**
+ * Updates status from the bytes returned at the start of a
+ * transaction. Long accesses return the full status, short accesses
+ * only the top byte. cmd is the first byte that was sent.
+ */
+static void ax_hw_update_status(ax_config* config,
+                                uint8_t cmd, unsigned char* data)
+{
+  uint16_t* status = &config->state.status;
+
+  if ((cmd & 0x70) == 0x70) {   /* long access */
+    *status = ((uint16_t)data[0] << 8) | data[1];
+  } else {
+    *status &= 0xFF;
+    *status |= ((uint16_t)data[0] << 8);
+  }
+
+  /* status was clocked out before a PWRMODE write took effect, so it
+   * says nothing about whether the new mode is powered up yet */
+  if (cmd == (AX_REG_PWRMODE | 0x80)) {
+    *status &= ~AX_STATUS_POWER_READY;
+  }
+  /* likewise a FIFOSTAT write, such as a commit, may have just put
+   * bytes in the fifo */
+  if (cmd == (AX_REG_FIFOSTAT | 0x80)) {
+    *status &= ~AX_STATUS_FIFO_EMPTY;
+  }
+}
+/**
+ * Passes a completed transaction to the trace
+ */
+static void ax_hw_trace(ax_config* config, unsigned char* sent,
+                        unsigned char* received, uint8_t length)
+{
+  config->trace->transactions++;
+  config->trace->bytes += length;
+
+  if (config->trace->record) {
+    config->trace->record(config->trace, sent, received, length);
+  }
+}
+/**
+ * Sends a single transaction, and updates status
+ */
+static void ax_hw_send(ax_config* config, unsigned char* data, uint8_t length)
+{
+  uint8_t cmd = data[0];
+  unsigned char sent[0x100];
+
+  if (config->trace) {          /* data is overwritten */
+    memcpy(sent, data, length);
+  }
+
+  if (config->trace && config->trace->transfer) { /* replay */
+    config->trace->transfer(config->trace, data, length);
+  } else {
+    config->spi_transfer(data, length);
+  }
+  ax_hw_update_status(config, cmd, data);
+
+  if (config->trace) {
+    ax_hw_trace(config, sent, data, length);
+  }
+}
+/**
+ * Sends all queued transactions. Uses the vectored transfer if there
+ * is one, otherwise one transfer per transaction.
+ */
+static void ax_hw_batch_flush(ax_config* config)
+{
+  ax_batch* batch = &config->batch;
+  ax_spi_xfer* last;
+  unsigned char sent[sizeof(batch->arena)];
+  uint8_t cmd;
+  uint8_t i;
+
+  if (batch->count == 0) {
+    return;                     /* nothing queued */
+  }
+
+  /* all in one go, unless a trace is answering */
+  if (config->spi_transfer_v && !(config->trace && config->trace->transfer)) {
+    last = &batch->xfer[batch->count-1];
+    cmd = last->data[0];
+
+    if (config->trace) {        /* arena is overwritten */
+      memcpy(sent, batch->arena, batch->arena_used);
+    }
+
+    config->spi_transfer_v(batch->xfer, batch->count);
+    ax_hw_update_status(config, cmd, last->data);
+
+    if (config->trace) {
+      for (i = 0; i < batch->count; i++) {
+        ax_hw_trace(config, sent + (batch->xfer[i].data - batch->arena),
+                    batch->xfer[i].data, batch->xfer[i].length);
+      }
+    }
+
+  } else {                      /* one at a time */
+    for (i = 0; i < batch->count; i++) {
+      ax_hw_send(config, batch->xfer[i].data, batch->xfer[i].length);
+    }
+  }
+
+  batch->count = 0;
+  batch->arena_used = 0;
+}
+/**
+ * Performs a transaction that returns data. Any queued writes are sent
+ * first.
+ */
+static void ax_hw_transfer(ax_config* config, unsigned char* data, uint8_t length)
+{
+  ax_hw_batch_flush(config);
+  ax_hw_send(config, data, length);
+}
+/**
+ * Space for a write transaction of length bytes. Between
+ * ax_hw_batch_begin and ax_hw_batch_end this is in the queue, so
+ * building the transaction there means it isn't copied again.
+ *
+ * Returns NULL if not batching
+ */
+static unsigned char* ax_hw_write_reserve(ax_config* config, uint8_t length)
+{
+  ax_batch* batch = &config->batch;
+  unsigned char* data;
+
+  if (batch->depth == 0) {
+    return NULL;                /* not batching */
+  }
+
+  /* make room in the queue */
+  if ((batch->count == AX_BATCH_XFERS) ||
+      ((batch->arena_used + length) > sizeof(batch->arena))) {
+    ax_hw_batch_flush(config);
+  }
+
+  /* queue */
+  data = batch->arena + batch->arena_used;
+  batch->xfer[batch->count].data = data;
+  batch->xfer[batch->count].length = length;
+  batch->arena_used += length;
+  batch->count++;
+
+  return data;
+}
+/**
+ * Performs a transaction that only writes. Between ax_hw_batch_begin
+ * and ax_hw_batch_end this is queued rather than sent, and status is
+ * not updated until the queue is flushed.
+ */
+static void ax_hw_write_transfer(ax_config* config, unsigned char* data, uint8_t length)
+{
+  unsigned char* queued = ax_hw_write_reserve(config, length);
+
+  if (queued) {
+    memcpy(queued, data, length);
+  } else {                      /* not batching, send now */
+    ax_hw_send(config, data, length);
+  }
+}
+/**
+ * Starts queuing writes. Calls may be nested.
+ */
+void ax_hw_batch_begin(ax_config* config)
+{
+  config->batch.depth++;
+}
+/**
+ * Stops queuing writes, and sends everything queued by the outermost
+ * ax_hw_batch_begin.
+ *
+ * Returns status
+ */
+uint16_t ax_hw_batch_end(ax_config* config)
+{
+  if (config->batch.depth > 0) {
+    config->batch.depth--;
+  }
+  if (config->batch.depth == 0) {
+    ax_hw_batch_flush(config);
+  }
+
+  return config->state.status;
+}
+
+
+/**
+ * SINGLE ACCESS ------------------------------------------
+ */
 
 /**
  * Reads register, and fully updates status. 8 bit
@@ -48,9 +323,7 @@ uint8_t ax_hw_read_register_long_8(ax_config* config, uint16_t reg)
   data[0] = ((reg >> 8) | 0x70);
   data[1] = (reg & 0xFF);
   data[2] = 0xFF;
-  config->spi_transfer(data, 3);
-
-  status = ((uint16_t)data[0] << 8) & data[1];
+  ax_hw_transfer(config, data, 3);
 
   return (uint8_t)data[2];
 }
@@ -69,10 +342,7 @@ uint8_t ax_hw_read_register_8(ax_config* config, uint16_t reg)
 
     data[0] = (reg & 0x7F);
     data[1] = 0xFF;
-    config->spi_transfer(data, 2);
-
-    status &= 0xFF;
-    status |= ((uint16_t)data[0] << 8);
+    ax_hw_transfer(config, data, 2);
 
     return (uint8_t)data[1];
   }
@@ -86,14 +356,16 @@ uint16_t ax_hw_write_register_long_8(ax_config* config, uint16_t reg, uint8_t va
 {
   unsigned char data[3];
 
+  if (ax_hw_shadow_hit(config, reg, &value, 1)) {
+    return config->state.status; /* already set */
+  }
+
   data[0] = ((reg >> 8) | 0xF0);
   data[1] = (reg & 0xFF);
   data[2] = value;
-  config->spi_transfer(data, 3);
-
-  status = ((uint16_t)data[0] << 8) & data[1];
+  ax_hw_write_transfer(config, data, 3);
 
-  return status;
+  return config->state.status;
 }
 /**
  * Write register, using long or short access as required. 8 bit
@@ -108,62 +380,70 @@ uint16_t ax_hw_write_register_8(ax_config* config, uint16_t reg, uint8_t value)
   } else {                      /* short access */
     unsigned char data[2];
 
+    if (ax_hw_shadow_hit(config, reg, &value, 1)) {
+      return config->state.status; /* already set */
+    }
+
     data[0] = ((reg & 0x7F) | 0x80);
     data[1] = value;
-    config->spi_transfer(data, 2);
-
-    status &= 0xFF;
-    status |= ((uint16_t)data[0] << 8);
+    ax_hw_write_transfer(config, data, 2);
 
-    return status;
+    return config->state.status;
   }
 }
 /**
- * Writes register, and fully updates status. 32 bit
+ * Writes consecutive registers in a single transaction, and fully
+ * updates status. Up to 253 bytes
  *
  * Returns status
  */
-uint16_t ax_hw_write_register_long_32(ax_config* config, uint16_t reg, uint32_t value)
+uint16_t ax_hw_write_register_long_bytes(ax_config* config, uint16_t reg,
+                                         uint8_t* ptr, uint8_t bytes)
 {
-  unsigned char data[6];
+  unsigned char data[0x100];
+
+  if (bytes > 0xFD) return 0;     /* Up to 253 bytes! */
+
+  if (ax_hw_shadow_hit(config, reg, ptr, bytes)) {
+    return config->state.status; /* already set */
+  }
 
   data[0] = ((reg >> 8) | 0xF0);
   data[1] = (reg & 0xFF);
-  data[2] = (value >> 24);
-  data[3] = (value >> 16);
-  data[4] = (value >> 8);
-  data[5] = (value >> 0);
-  config->spi_transfer(data, 6);
+  memcpy(data+2, ptr, bytes);
+  ax_hw_write_transfer(config, data, 2+bytes);
 
-  status = ((uint16_t)data[0] << 8) & data[1];
-
-  return status;
+  return config->state.status;
 }
 /**
- * Write register, using long or short access as required. 32 bit
+ * Writes consecutive registers in a single transaction, using long or
+ * short access as required. Up to 253 bytes
+ *
+ * The address auto-increments within the transaction, so this must not
+ * be used for FIFODATA.
  *
  * Returns status
  */
-uint16_t ax_hw_write_register_32(ax_config* config, uint16_t reg, uint32_t value)
+uint16_t ax_hw_write_register_bytes(ax_config* config, uint16_t reg,
+                                    uint8_t* ptr, uint8_t bytes)
 {
   if (reg > 0x70) {             /* long access */
-    return ax_hw_write_register_long_32(config, reg, value);
+    return ax_hw_write_register_long_bytes(config, reg, ptr, bytes);
 
   } else {                      /* short access */
-    unsigned char data[5];
+    unsigned char data[0x100];
 
-    data[0] = ((reg & 0x7F) | 0x80);
-    data[1] = (value >> 24);
-    data[2] = (value >> 16);
-    data[3] = (value >> 8);
-    data[4] = (value >> 0);
+    if (bytes > 0xFD) return 0;   /* Up to 253 bytes! */
 
-    config->spi_transfer(data, 5);
+    if (ax_hw_shadow_hit(config, reg, ptr, bytes)) {
+      return config->state.status; /* already set */
+    }
 
-    status &= 0xFF;
-    status |= ((uint16_t)data[0] << 8);
+    data[0] = ((reg & 0x7F) | 0x80);
+    memcpy(data+1, ptr, bytes);
+    ax_hw_write_transfer(config, data, 1+bytes);
 
-    return status;
+    return config->state.status;
   }
 }
 /**
@@ -181,13 +461,11 @@ uint16_t ax_hw_read_register_long_bytes(ax_config* config, uint16_t reg,
   data[0] = ((reg >> 8) | 0x70);
   data[1] = (reg & 0xFF);
   memset(data+2, 0xFF, bytes);
-  config->spi_transfer(data, 2+bytes);
-
-  status = ((uint16_t)data[0] << 8) & data[1];
+  ax_hw_transfer(config, data, 2+bytes);
 
   memcpy(ptr, data+2, bytes);
 
-  return status;
+  return config->state.status;
 }
 /**
  * Reads register, using long or short access as required. Up to 4 bytes
@@ -205,14 +483,11 @@ uint16_t ax_hw_read_register_bytes(ax_config* config, uint16_t reg,
 
     data[0] = (reg & 0x7F);
     memset(data+1, 0xFF, bytes);
-    config->spi_transfer(data, 1+bytes);
-
-    status &= 0xFF;
-    status |= ((uint16_t)data[0] << 8);
+    ax_hw_transfer(config, data, 1+bytes);
 
     memcpy(ptr, data+1, bytes);
 
-    return status;
+    return config->state.status;
   }
 }
 
@@ -222,18 +497,37 @@ uint16_t ax_hw_read_register_bytes(ax_config* config, uint16_t reg,
  */
 
 /**
- * weak combinations
+ * burst writes, MSB first
  */
 uint16_t ax_hw_write_register_16(ax_config* config, uint16_t reg, uint16_t value)
 {
-  ax_hw_write_register_8(config,        reg,   (value >> 8)); /* MSB first */
-  return ax_hw_write_register_8(config, reg+1, (value >> 0));
+  uint8_t ptr[2];
+
+  ptr[0] = (value >> 8);
+  ptr[1] = (value >> 0);
+
+  return ax_hw_write_register_bytes(config, reg, ptr, 2);
 }
 uint16_t ax_hw_write_register_24(ax_config* config, uint16_t reg, uint32_t value)
 {
-  ax_hw_write_register_8(config,        reg,   (value >> 16)); /* MSB first */
-  ax_hw_write_register_8(config,        reg+1, (value >> 8));
-  return ax_hw_write_register_8(config, reg+2, (value >> 0));
+  uint8_t ptr[3];
+
+  ptr[0] = (value >> 16);
+  ptr[1] = (value >> 8);
+  ptr[2] = (value >> 0);
+
+  return ax_hw_write_register_bytes(config, reg, ptr, 3);
+}
+uint16_t ax_hw_write_register_32(ax_config* config, uint16_t reg, uint32_t value)
+{
+  uint8_t ptr[4];
+
+  ptr[0] = (value >> 24);
+  ptr[1] = (value >> 16);
+  ptr[2] = (value >> 8);
+  ptr[3] = (value >> 0);
+
+  return ax_hw_write_register_bytes(config, reg, ptr, 4);
 }
 uint16_t ax_hw_read_register_16(ax_config* config, uint16_t reg)
 {
@@ -263,24 +557,60 @@ uint32_t ax_hw_read_register_32(ax_config* config, uint16_t reg)
  */
 
 /**
- * Writes buffer to fifo. First byte of buffer is discarded.
+ * Writes buffer to fifo. At most 254 bytes
  *
- * Returns status
+ * Returns status, or -1 if buffer is too long and nothing was written
  */
-uint16_t ax_hw_write_fifo(ax_config* config, uint8_t* buffer, uint16_t length)
+int ax_hw_write_fifo(ax_config* config, uint8_t* buffer, uint16_t length)
 {
-  uint8_t data[0x100];
+  ax_spi_xfer segment;
+
+  segment.data = buffer;
+  segment.length = length;
+
+  return ax_hw_write_fifo_v(config, &segment, 1);
+}
+/**
+ * Writes segments to the fifo, in order, as a single transaction. The
+ * segments are gathered straight into the transaction, so the caller
+ * doesn't need to assemble them. At most 254 bytes in total.
+ *
+ * Returns status, or -1 if the segments are too long and nothing was
+ * written
+ */
+int ax_hw_write_fifo_v(ax_config* config, ax_spi_xfer* segments, uint8_t count)
+{
+  unsigned char buffer[0x100];
+  unsigned char* data;
+  uint32_t length = 1;
+  uint8_t i;
+
+  for (i = 0; i < count; i++) {
+    length += segments[i].length;
+  }
+  if (length > 0xFF) {          /* must fit one transaction */
+    return -1;
+  }
+
+  data = ax_hw_write_reserve(config, length);
+  if (!data) {
+    data = buffer;              /* not batching, send from here */
+  }
 
   /* write (short access) */
   data[0] = ((AX_REG_FIFODATA & 0x7F) | 0x80);
-  memcpy(data+1, buffer, length);
-
-  config->spi_transfer(data, length+1);
+  length = 1;
+  for (i = 0; i < count; i++) {
+    memcpy(data + length, segments[i].data, segments[i].length);
+    length += segments[i].length;
+  }
 
-  status &= 0xFF;
-  status |= ((uint16_t)data[0] << 8);
+  if (data == buffer) {
+    ax_hw_send(config, data, length);
+  }
+  config->state.fifo_tx_written += length - 1;
 
-  return status;
+  return config->state.status;
 }
 /**
  * Reads buffer from fifo. First byte of returned buffer is top byte of status
@@ -292,27 +622,83 @@ uint16_t ax_hw_read_fifo(ax_config* config, uint8_t* buffer, uint16_t length)
   /* read (short access) */
   buffer[0] = (AX_REG_FIFODATA & 0x7F);
 
-  config->spi_transfer(buffer, length);
-
-  status &= 0xFF;
-  status |= ((uint16_t)buffer[0] << 8);
+  ax_hw_transfer(config, buffer, length);
 
-  return status;
+  return config->state.status;
 }
 
 
 
+/**
+ * TRACE -------------------------------------------------
+ */
+
+/**
+ * Marks the start of a public API call in the trace
+ */
+void ax_hw_trace_call(ax_config* config, const char* name)
+{
+  if (config->trace && config->trace->call) {
+    ax_hw_batch_flush(config);  /* queued writes belong to the last call */
+    config->trace->call(config->trace, name);
+  }
+}
+
+/**
+ * STATUS ------------------------------------------------
+ */
+
 /**
  * Returns the status from the last transaction
  */
-uint16_t ax_hw_status(void)
+uint16_t ax_hw_status(ax_config* config)
 {
-  return status;
+  return config->state.status;
 }
 /**
- * Polls the hardware for the latest status, and returns it.
+ * Polls the hardware for the latest status, and returns it. This is a
+ * long access with no data, so it has no side-effects.
  */
-uint16_t ax_hw_poll_status(void)
+uint16_t ax_hw_poll_status(ax_config* config)
 {
-  return 0;
+  unsigned char data[2];
+
+  data[0] = ((AX_REG_SILICONREVISION >> 8) | 0x70);
+  data[1] = (AX_REG_SILICONREVISION & 0xFF);
+  ax_hw_transfer(config, data, 2);
+
+  return config->state.status;
+}
+
+/**
+ * Decode a status word
+ */
+uint8_t ax_hw_status_power_ready(uint16_t status)
+{
+  return (status & AX_STATUS_POWER_READY) ? 1 : 0;
+}
+/* POWER_READY is the status copy of POWSTAT SVMODEM */
+uint8_t ax_hw_status_svmodem(uint16_t status)
+{
+  return ax_hw_status_power_ready(status);
+}
+uint8_t ax_hw_status_pll_lock(uint16_t status)
+{
+  return (status & AX_STATUS_PLL_LOCK) ? 1 : 0;
+}
+uint8_t ax_hw_status_fifo_overflow(uint16_t status)
+{
+  return (status & AX_STATUS_FIFO_OVERFLOW) ? 1 : 0;
+}
+uint8_t ax_hw_status_fifo_underflow(uint16_t status)
+{
+  return (status & AX_STATUS_FIFO_UNDERFLOW) ? 1 : 0;
+}
+uint8_t ax_hw_status_fifo_full(uint16_t status)
+{
+  return (status & AX_STATUS_FIFO_FULL) ? 1 : 0;
+}
+uint8_t ax_hw_status_fifo_empty(uint16_t status)
+{
+  return (status & AX_STATUS_FIFO_EMPTY) ? 1 : 0;
 }
@@ -33,6 +33,10 @@ uint16_t ax_hw_write_register_long_8(ax_config* config, uint16_t reg, uint8_t va
 uint8_t ax_hw_read_register_8(ax_config* config, uint16_t reg);
 uint16_t ax_hw_write_register_8(ax_config* config, uint16_t reg, uint8_t value);
 
+uint16_t ax_hw_write_register_long_bytes(ax_config* config, uint16_t reg,
+                                         uint8_t* ptr, uint8_t bytes);
+uint16_t ax_hw_write_register_bytes(ax_config* config, uint16_t reg,
+                                    uint8_t* ptr, uint8_t bytes);
 uint16_t ax_hw_read_register_long_bytes(ax_config* config, uint16_t reg,
                                         uint8_t* ptr, uint8_t bytes);
 uint16_t ax_hw_read_register_bytes(ax_config* config, uint16_t reg,
@@ -45,10 +49,26 @@ uint16_t ax_hw_read_register_16(ax_config* config, uint16_t reg);
 uint32_t ax_hw_read_register_24(ax_config* config, uint16_t reg);
 uint32_t ax_hw_read_register_32(ax_config* config, uint16_t reg);
 
-uint16_t ax_hw_write_fifo(ax_config* config, uint8_t* buffer, uint16_t length);
+int ax_hw_write_fifo(ax_config* config, uint8_t* buffer, uint16_t length);
+int ax_hw_write_fifo_v(ax_config* config, ax_spi_xfer* segments, uint8_t count);
 uint16_t ax_hw_read_fifo(ax_config* config, uint8_t* buffer, uint16_t length);
 
-uint16_t ax_hw_status(void);
-uint16_t ax_hw_poll_status(void);
+void ax_hw_shadow_invalidate(ax_config* config);
+
+void ax_hw_batch_begin(ax_config* config);
+uint16_t ax_hw_batch_end(ax_config* config);
+
+void ax_hw_trace_call(ax_config* config, const char* name);
+
+uint16_t ax_hw_status(ax_config* config);
+uint16_t ax_hw_poll_status(ax_config* config);
+
+uint8_t ax_hw_status_power_ready(uint16_t status);
+uint8_t ax_hw_status_svmodem(uint16_t status);
+uint8_t ax_hw_status_pll_lock(uint16_t status);
+uint8_t ax_hw_status_fifo_overflow(uint16_t status);
+uint8_t ax_hw_status_fifo_underflow(uint16_t status);
+uint8_t ax_hw_status_fifo_full(uint16_t status);
+uint8_t ax_hw_status_fifo_empty(uint16_t status);
 
 #endif  /* AX_HW_H */
@@ -29,11 +29,20 @@ ffibuilder = FFI()
 debug = True if 'debug' in sys.argv else False
 singleport = True if 'singleport' in sys.argv else False
 
-# headers we'd like to use from python
-ax_headers = ["ax/ax.h"]
+# headers we'd like to use from python. the host side ones have
+# pthread and libc types in their structs, which the compiler fills in
+ffibuilder.cdef("""
+typedef int... pthread_t;
+typedef struct { ...; } pthread_mutex_t;
+typedef struct { ...; } pthread_cond_t;
+typedef ... FILE;
+struct timespec { ...; };
+""")
+ax_headers = ["ax/ax.h", "ax_trace.h", "ax_tx_async.h", "ax_rx_ring.h"]
 for header in ax_headers:
     header = open(header, 'r').read()
     h = re.sub('[#].*\n', '', header) # remove header guards
+    h = re.sub(r'\[AX_\w+\]', '[...]', h) # array sizes from #defines
     ffibuilder.cdef(h)
 
 # definitions we'd like to use from python
@@ -64,14 +73,35 @@ ffibuilder.cdef("""
 enum ax_set_spi_transfer_status
      ax_set_spi_transfer(ax_config* config, int spi);
 void ax_platform_init(ax_config* config);
+int ax_irq_open(int gpiochip, int line);
+int ax_irq_wait(int fd, int timeout_ms);
+void ax_irq_close(int fd);
+void ax_irq_set(ax_config* config, int fd);
+uint32_t ax_rs_encoded_length(uint16_t length, uint8_t shortening);
+int32_t ax_rs_encode(uint8_t* data, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* frame, uint16_t frame_size);
+int32_t ax_rs_decode(uint8_t* frame, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* data, uint16_t* data_length);
+int32_t ax_rs_tx_packet(ax_config* config, ax_modulation* mod,
+                        uint8_t* data, uint16_t length,
+                        uint8_t shortening, uint8_t depth);
 """)
 spi_callbacks_source = """
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 #include "ax/ax.h"
+#include "ax_irq_linux.h"
+#include "ax_trace.h"
+#include "ax_tx_async.h"
+#include "ax_rs.h"
+#include "ax_rx_ring.h"
 
 static const char *device = "/dev/spidev32766.0";
 static uint32_t speed = 5000000;     /* 5MHz */
@@ -99,6 +129,30 @@ void chip_spi_transfer_spi(unsigned char* data, uint8_t length)
   }
 }
 
+void chip_spi_transfer_spi_v(ax_spi_xfer* xfer, uint8_t count)
+{
+  struct spi_ioc_transfer tr[AX_BATCH_XFERS];
+  int ret;
+  uint8_t i;
+
+  memset(tr, 0, sizeof(tr));
+
+  for (i = 0; i < count; i++) {
+    tr[i].tx_buf = (unsigned long)xfer[i].data;
+    tr[i].rx_buf = (unsigned long)xfer[i].data;
+    tr[i].len = xfer[i].length;
+    tr[i].speed_hz = speed;
+    tr[i].bits_per_word = bits;
+    tr[i].cs_change = (i < count-1); /* release cs between transactions */
+  }
+
+  ret = ioctl(fd, SPI_IOC_MESSAGE(count), tr);
+  if (ret < 0) {
+    fprintf(stderr, "can't send %d spi transactions: %s\\n",
+            count, strerror(errno));
+  }
+}
+
 enum ax_set_spi_transfer_status
      ax_set_spi_transfer(ax_config* config, int spi)
 {
@@ -149,6 +203,10 @@ enum ax_set_spi_transfer_status
   }
 
   config->spi_transfer = chip_spi_transfer_spi;
+  config->spi_transfer_v = chip_spi_transfer_spi_v;
+  config->sleep_us = ax_sleep_us;
+  config->time_us = ax_time_us;
+  config->time_ns = ax_time_ns;
   config->transmit_path = AX_TRANSMIT_PATH_SE;
 
   return AX_SET_SPI_TRANSFER_OK;
@@ -173,10 +231,12 @@ if debug:
     compile_args.append("-DDEBUG")
 
 # source files to build
-ax_sources = ["ax/ax.c", "ax/ax_hw.c", "ax/ax_modes.c", "ax/ax_params.c"]
+ax_sources = ["ax/ax.c", "ax/ax_hw.c", "ax/ax_modes.c", "ax/ax_params.c",
+              "ax_irq_linux.c", "ax_trace.c", "ax_tx_async.c",
+              "ax_rs.c", "rs8/rs8.c", "ax_rx_ring.c"]
 ffibuilder.set_source("_ax_radio",
                       definitions_enum + status_enum + spi_callbacks_source,
-                      sources=ax_sources,
+                      sources=ax_sources, libraries=['pthread'],
                       include_dirs=['.'], extra_compile_args=compile_args)
 
 # main
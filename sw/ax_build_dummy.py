@@ -27,12 +27,22 @@ ffibuilder = FFI()
 
 # command line args
 debug = True if 'debug' in sys.argv else False
+emulator = True if 'emulator' in sys.argv else False # emulated radio
 
-# headers we'd like to use from python
-ax_headers = ["ax/ax.h"]
+# headers we'd like to use from python. the host side ones have
+# pthread and libc types in their structs, which the compiler fills in
+ffibuilder.cdef("""
+typedef int... pthread_t;
+typedef struct { ...; } pthread_mutex_t;
+typedef struct { ...; } pthread_cond_t;
+typedef ... FILE;
+struct timespec { ...; };
+""")
+ax_headers = ["ax/ax.h", "ax_trace.h", "ax_tx_async.h", "ax_rx_ring.h"]
 for header in ax_headers:
     header = open(header, 'r').read()
     h = re.sub('[#].*\n', '', header) # remove header guards
+    h = re.sub(r'\[AX_\w+\]', '[...]', h) # array sizes from #defines
     ffibuilder.cdef(h)
 
 # definitions we'd like to use from python
@@ -63,10 +73,78 @@ ffibuilder.cdef("""
 enum ax_set_spi_transfer_status
      ax_set_spi_transfer(ax_config* config, int spi);
 void ax_platform_init(ax_config* config);
+int ax_irq_open(int gpiochip, int line);
+int ax_irq_wait(int fd, int timeout_ms);
+void ax_irq_close(int fd);
+void ax_irq_set(ax_config* config, int fd);
+uint32_t ax_rs_encoded_length(uint16_t length, uint8_t shortening);
+int32_t ax_rs_encode(uint8_t* data, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* frame, uint16_t frame_size);
+int32_t ax_rs_decode(uint8_t* frame, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* data, uint16_t* data_length);
+int32_t ax_rs_tx_packet(ax_config* config, ax_modulation* mod,
+                        uint8_t* data, uint16_t length,
+                        uint8_t shortening, uint8_t depth);
+""")
+if emulator:
+    ffibuilder.cdef("""
+void ax_emulator_reset(void);
+uint16_t ax_emulator_rx_load(const uint8_t* bytes, uint16_t length);
+uint16_t ax_emulator_rx_packet(const uint8_t* data, uint16_t length, uint8_t rssi);
+uint32_t ax_emulator_tx_read(uint8_t* buffer, uint32_t length);
+uint32_t ax_emulator_tx_dropped(void);
+void ax_emulator_set_tx_rate(uint32_t bytes_per_second);
+uint8_t ax_emulator_register(uint16_t reg);
+uint8_t ax_emulator_irq(void);
+int ax_emulator_irq_open(void);
+void ax_emulator_irq_close(void);
 """)
 spi_callbacks_source = """
 #include "ax/ax.h"
+#include "ax_trace.h"
+#include "ax_tx_async.h"
+#include "ax_rs.h"
+#include "ax_rx_ring.h"
+"""
+if emulator:
+    spi_callbacks_source += """
+#include <time.h>
+#include "ax_emulator.h"
+#include "ax_irq_linux.h"
+
+static uint32_t emulator_time_us(void)
+{
+  struct timespec now;
 
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+static uint64_t emulator_time_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+enum ax_set_spi_transfer_status
+     ax_set_spi_transfer(ax_config* config, int spi)
+{
+  ax_emulator_reset();
+  config->spi_transfer = ax_emulator_spi_transfer;
+  config->irq_wait = ax_emulator_irq_wait;
+  config->time_us = emulator_time_us;
+  config->time_ns = emulator_time_ns;
+
+  return AX_SET_SPI_TRANSFER_OK;
+}
+"""
+else:
+    spi_callbacks_source += """
 void wiringpi_spi_transfer_spi_0(unsigned char* data, uint8_t length) {
   /* dummy */
 }
@@ -79,20 +157,34 @@ enum ax_set_spi_transfer_status
 
   return AX_SET_SPI_TRANSFER_OK;
 }
-
+"""
+spi_callbacks_source += """
 void ax_platform_init(ax_config* config) { /* nothing */ }
 """
+if not emulator:                # the emulator tests the real ones
+    spi_callbacks_source += """
+int ax_irq_open(int gpiochip, int line) { return -1; /* dummy */ }
+int ax_irq_wait(int fd, int timeout_ms) { return 0; }
+void ax_irq_close(int fd) { }
+void ax_irq_set(ax_config* config, int fd) { }
+"""
 
-compile_args = ["-D_AX_DUMMY", "-D_AX_TX_DIFF"]
+compile_args = ["-D_AX_TX_DIFF"]
+if not emulator:
+    compile_args.append("-D_AX_DUMMY")
 if debug:
     compile_args.append("-DDEBUG")
 
 # source files to build
-ax_sources = ["ax/ax.c", "ax/ax_hw.c", "ax/ax_modes.c", "ax/ax_params.c"]
+ax_sources = ["ax/ax.c", "ax/ax_hw.c", "ax/ax_modes.c", "ax/ax_params.c",
+              "ax_trace.c", "ax_tx_async.c",
+              "ax_rs.c", "rs8/rs8.c", "ax_rx_ring.c"]
+if emulator:
+    ax_sources += ["ax_emulator.c", "ax_irq_linux.c"]
 ffibuilder.set_source("_ax_radio",
                       definitions_enum + status_enum + spi_callbacks_source,
-                      sources=ax_sources, include_dirs=['.'],
-                      extra_compile_args=compile_args)
+                      sources=ax_sources, libraries=['pthread'],
+                      include_dirs=['.'], extra_compile_args=compile_args)
 
 
 
@@ -28,11 +28,20 @@ ffibuilder = FFI()
 # command line args
 debug = True if 'debug' in sys.argv else False
 
-# headers we'd like to use from python
-ax_headers = ["ax/ax.h"]
+# headers we'd like to use from python. the host side ones have
+# pthread and libc types in their structs, which the compiler fills in
+ffibuilder.cdef("""
+typedef int... pthread_t;
+typedef struct { ...; } pthread_mutex_t;
+typedef struct { ...; } pthread_cond_t;
+typedef ... FILE;
+struct timespec { ...; };
+""")
+ax_headers = ["ax/ax.h", "ax_trace.h", "ax_tx_async.h", "ax_rx_ring.h"]
 for header in ax_headers:
     header = open(header, 'r').read()
     h = re.sub('[#].*\n', '', header) # remove header guards
+    h = re.sub(r'\[AX_\w+\]', '[...]', h) # array sizes from #defines
     ffibuilder.cdef(h)
 
 # definitions we'd like to use from python
@@ -63,11 +72,35 @@ ffibuilder.cdef("""
 enum ax_set_spi_transfer_status
      ax_set_spi_transfer(ax_config* config, int spi);
 void ax_platform_init(ax_config* config);
+int ax_irq_open(int gpiochip, int line);
+int ax_irq_wait(int fd, int timeout_ms);
+void ax_irq_close(int fd);
+void ax_irq_set(ax_config* config, int fd);
+uint32_t ax_rs_encoded_length(uint16_t length, uint8_t shortening);
+int32_t ax_rs_encode(uint8_t* data, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* frame, uint16_t frame_size);
+int32_t ax_rs_decode(uint8_t* frame, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* data, uint16_t* data_length);
+int32_t ax_rs_tx_packet(ax_config* config, ax_modulation* mod,
+                        uint8_t* data, uint16_t length,
+                        uint8_t shortening, uint8_t depth);
 """)
 spi_callbacks_source = """
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
 #include <wiringPi.h>
 #include <wiringPiSPI.h>
 #include "ax/ax.h"
+#include "ax_irq_linux.h"
+#include "ax_trace.h"
+#include "ax_tx_async.h"
+#include "ax_rs.h"
+#include "ax_rx_ring.h"
 #define SPI_SPEED	5000000     /* 5MHz */
 
 void wiringpi_spi_transfer_spi_0(unsigned char* data, uint8_t length) {
@@ -77,6 +110,34 @@ void wiringpi_spi_transfer_spi_1(unsigned char* data, uint8_t length) {
   wiringPiSPIDataRW(1, data, length);
 }
 
+/* all transactions in a single ioctl, releasing cs in between */
+void spidev_spi_transfer_v(int channel, ax_spi_xfer* xfer, uint8_t count) {
+  struct spi_ioc_transfer tr[AX_BATCH_XFERS];
+  uint8_t i;
+
+  memset(tr, 0, sizeof(tr));
+
+  for (i = 0; i < count; i++) {
+    tr[i].tx_buf = (unsigned long)xfer[i].data;
+    tr[i].rx_buf = (unsigned long)xfer[i].data;
+    tr[i].len = xfer[i].length;
+    tr[i].speed_hz = SPI_SPEED;
+    tr[i].bits_per_word = 8;
+    tr[i].cs_change = (i < count-1);
+  }
+
+  if (ioctl(wiringPiSPIGetFd(channel), SPI_IOC_MESSAGE(count), tr) < 0) {
+    fprintf(stderr, "can't send %d spi transactions on channel %d: %s\\n",
+            count, channel, strerror(errno));
+  }
+}
+void wiringpi_spi_transfer_v_spi_0(ax_spi_xfer* xfer, uint8_t count) {
+  spidev_spi_transfer_v(0, xfer, count);
+}
+void wiringpi_spi_transfer_v_spi_1(ax_spi_xfer* xfer, uint8_t count) {
+  spidev_spi_transfer_v(1, xfer, count);
+}
+
 enum ax_set_spi_transfer_status
      ax_set_spi_transfer(ax_config* config, int spi)
 {
@@ -87,11 +148,16 @@ enum ax_set_spi_transfer_status
 
   if (spi == 0) {
     config->spi_transfer = wiringpi_spi_transfer_spi_0;
+    config->spi_transfer_v = wiringpi_spi_transfer_v_spi_0;
   } else if (spi == 1) {
     config->spi_transfer = wiringpi_spi_transfer_spi_1;
+    config->spi_transfer_v = wiringpi_spi_transfer_v_spi_1;
   } else {
     return AX_SET_SPI_TRANSFER_BAD_SPI;
   }
+  config->sleep_us = ax_sleep_us;
+  config->time_us = ax_time_us;
+  config->time_ns = ax_time_ns;
 
   return AX_SET_SPI_TRANSFER_OK;
 }
@@ -104,10 +170,12 @@ if debug:
     compile_args.append("-DDEBUG")
 
 # source files to build
-ax_sources = ["ax/ax.c", "ax/ax_hw.c", "ax/ax_modes.c", "ax/ax_params.c"]
+ax_sources = ["ax/ax.c", "ax/ax_hw.c", "ax/ax_modes.c", "ax/ax_params.c",
+              "ax_irq_linux.c", "ax_trace.c", "ax_tx_async.c",
+              "ax_rs.c", "rs8/rs8.c", "ax_rx_ring.c"]
 ffibuilder.set_source("_ax_radio",
                       definitions_enum + status_enum + spi_callbacks_source,
-                      sources=ax_sources, libraries=['wiringPi'],
+                      sources=ax_sources, libraries=['wiringPi', 'pthread'],
                       include_dirs=['.'], extra_compile_args=compile_args)
 
 # main
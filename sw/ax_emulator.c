@@ -0,0 +1,672 @@
+/*
+ * Register level emulation of an ax5043 radio
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* for clock_gettime and nanosleep */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "ax/ax.h"
+#include "ax/ax_reg.h"
+#include "ax/ax_reg_values.h"
+#include "ax/ax_fifo.h"
+#include "ax_emulator.h"
+
+#define MIN(a,b) ((a < b) ? (a) : (b))
+
+/**
+ * Emulates one radio. Plugs in as spi_transfer, so there is a single
+ * instance.
+ *
+ * Modelled: register file with reset values for SCRATCH and
+ * SILICONREVISION, PWRMODE reset, XTALSTATUS, POWSTAT, PLLRANGING
+ * completion, RADIOSTATE, IRQREQUEST and the status word. The fifo
+ * supports FIFODATA, FIFOSTAT commands, FIFOCOUNT, FIFOFREE and
+ * FIFOTHRESH. In FULLTX committed bytes are sent at tx_rate (or
+ * immediately if 0), and can be read back with ax_emulator_tx_read.
+ * Sent bytes that don't fit in tx are counted and dropped. Nothing is
+ * demodulated; rx chunks are loaded by the caller.
+ *
+ * The API may be called from several threads, one at a time.
+ */
+typedef struct ax_emulator {
+  uint8_t reg[0x1000];
+
+  /* fifo */
+  uint8_t fifo[0x100];
+  uint16_t fifo_head;           /* index of the oldest byte */
+  uint16_t fifo_count;          /* bytes in the fifo */
+  uint16_t fifo_committed;      /* tx bytes that may be sent */
+  uint8_t fifo_flags;           /* AX_FIFO_OVER | AX_FIFO_UNDER */
+
+  /* transmit */
+  uint32_t tx_rate;             /* bytes per second, 0 = instant */
+  struct timespec tx_last;      /* when tx bytes were last sent */
+  uint8_t tx[0x10000];          /* bytes sent, a ring */
+  uint32_t tx_head;             /* index of the oldest byte */
+  uint32_t tx_length;           /* bytes in tx */
+  uint32_t tx_dropped;          /* bytes sent while tx was full */
+} ax_emulator;
+
+static ax_emulator emu;
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Rising edges of the IRQ pin, as an eventfd. Outside emu so it
+ * survives a reset
+ */
+static struct {
+  int fd;                       /* -1 if not open */
+  pthread_t thread;             /* watches the pin */
+  int stop;
+  uint8_t last;                 /* level when last looked at */
+} emu_irq = { .fd = -1 };
+
+/**
+ * REGISTERS ----------------------------------------------
+ */
+
+static uint8_t ax_emulator_mode(void)
+{
+  return emu.reg[AX_REG_PWRMODE] & 0xF;
+}
+static uint16_t ax_emulator_thresh(void)
+{
+  return ((emu.reg[AX_REG_FIFOTHRESH] << 8) | emu.reg[AX_REG_FIFOTHRESH+1]) & 0x1FF;
+}
+/**
+ * Sends committed tx bytes, according to how much time has passed
+ */
+static void ax_emulator_tx_update(void)
+{
+  struct timespec now;
+  uint64_t elapsed_us;
+  uint32_t n;
+
+  if (ax_emulator_mode() != AX_PWRMODE_FULLTX) {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if (emu.tx_rate == 0) {
+    n = emu.fifo_committed;
+  } else {
+    elapsed_us = ((uint64_t)(now.tv_sec - emu.tx_last.tv_sec) * 1000000) +
+      ((now.tv_nsec - emu.tx_last.tv_nsec) / 1000);
+    n = MIN(emu.fifo_committed, (elapsed_us * emu.tx_rate) / 1000000);
+    if (n < emu.fifo_committed) { /* keep the fractional time */
+      elapsed_us = ((uint64_t)n * 1000000) / emu.tx_rate;
+      now.tv_sec = emu.tx_last.tv_sec + (elapsed_us / 1000000);
+      now.tv_nsec = emu.tx_last.tv_nsec + ((elapsed_us % 1000000) * 1000);
+      if (now.tv_nsec >= 1000000000) {
+        now.tv_sec++;
+        now.tv_nsec -= 1000000000;
+      }
+    }
+  }
+  emu.tx_last = now;
+
+  while (n--) {
+    if (emu.tx_length < sizeof(emu.tx)) {
+      emu.tx[(emu.tx_head + emu.tx_length) % sizeof(emu.tx)] =
+        emu.fifo[emu.fifo_head];
+      emu.tx_length++;
+    } else {
+      emu.tx_dropped++;         /* not read out in time */
+    }
+    emu.fifo_head = (emu.fifo_head + 1) % sizeof(emu.fifo);
+    emu.fifo_count--;
+    emu.fifo_committed--;
+  }
+}
+/**
+ * Value of IRQREQUEST
+ */
+static uint16_t ax_emulator_irq_request(void)
+{
+  uint16_t request = 0;
+
+  if (emu.fifo_count) {
+    request |= AX_IRQMFIFONOTEMPTY;
+  }
+  if (emu.fifo_count < sizeof(emu.fifo)) {
+    request |= AX_IRQMFIFONOTFULL;
+  }
+  if (emu.fifo_count > ax_emulator_thresh()) {
+    request |= AX_IRQMFIFOTHRCNT;
+  }
+  if ((sizeof(emu.fifo) - emu.fifo_count) > ax_emulator_thresh()) {
+    request |= AX_IRQMFIFOTHRFREE;
+  }
+  if (emu.fifo_flags) {
+    request |= AX_IRQMFIFOERROR;
+  }
+
+  return request;
+}
+/**
+ * Reset state, for ax_emulator_reset and PWRMODE reset. The tx rate
+ * is kept
+ */
+static void ax_emulator_reset_state(void)
+{
+  uint32_t tx_rate = emu.tx_rate;
+
+  memset(&emu, 0, sizeof(emu));
+  emu.tx_rate = tx_rate;
+
+  emu.reg[AX_REG_SILICONREVISION] = AX_SILICONREVISION;
+  emu.reg[AX_REG_SCRATCH] = AX_SCRATCH;
+  emu.reg[AX_REG_POWSTAT] = 0xFF; /* all supplies good */
+  emu.reg[AX_REG_PWRMODE] = AX_PWRMODE_REFEN | AX_PWRMODE_XOEN;
+  emu.reg[AX_REG_XTALSTATUS] = AX_XTALSTATUS_RUNNING;
+  emu.reg[AX_REG_PINFUNCIRQ] = 0x03; /* irq output */
+}
+/**
+ * Level of the IRQ pin
+ */
+static uint8_t ax_emulator_irq_pin(void)
+{
+  uint16_t mask = (emu.reg[AX_REG_IRQMASK] << 8) | emu.reg[AX_REG_IRQMASK+1];
+
+  ax_emulator_tx_update();
+
+  return (ax_emulator_irq_request() & mask) ? 1 : 0;
+}
+/**
+ * Signals the eventfd if the IRQ pin has risen since it was last looked
+ * at. Called with emu_lock held after anything that can move the pin,
+ * so a low level is seen even if the watching thread sleeps through it
+ */
+static void ax_emulator_irq_edge(void)
+{
+  uint64_t one = 1;
+  uint8_t pin;
+
+  if (emu_irq.fd < 0) {
+    return;
+  }
+
+  pin = ax_emulator_irq_pin();
+  if (pin && !emu_irq.last) {
+    if (write(emu_irq.fd, &one, sizeof(one)) < 0) {
+      /* counter full, it's readable anyhow */
+    }
+  }
+  emu_irq.last = pin;
+}
+/**
+ * Status word, returned at the start of every transaction
+ */
+static uint16_t ax_emulator_status(void)
+{
+  uint8_t mode = ax_emulator_mode();
+  uint16_t status = AX_STATUS_PWRGOOD;
+
+  if (mode != AX_PWRMODE_DEEPSLEEP) {
+    status |= AX_STATUS_POWER_READY;
+  }
+  if (mode >= AX_PWRMODE_SYNTHRX) {
+    status |= AX_STATUS_PLL_LOCK;
+  }
+  if (emu.reg[AX_REG_XTALSTATUS]) {
+    status |= AX_STATUS_XTAL_OSCILLATOR_RUNNING;
+  }
+  if (emu.fifo_flags & AX_FIFO_OVER)  { status |= AX_STATUS_FIFO_OVERFLOW; }
+  if (emu.fifo_flags & AX_FIFO_UNDER) { status |= AX_STATUS_FIFO_UNDERFLOW; }
+  if (emu.fifo_count == 0)            { status |= AX_STATUS_FIFO_EMPTY; }
+  if (emu.fifo_count == sizeof(emu.fifo)) { status |= AX_STATUS_FIFO_FULL; }
+  if (emu.fifo_count > ax_emulator_thresh()) {
+    status |= AX_STATUS_THRESHOLD_COUNT;
+  }
+  if ((sizeof(emu.fifo) - emu.fifo_count) > ax_emulator_thresh()) {
+    status |= AX_STATUS_THRESHOLD_FREE;
+  }
+
+  return status;
+}
+/**
+ * Register read, with side effects
+ */
+static uint8_t ax_emulator_read(uint16_t reg)
+{
+  uint8_t value;
+
+  switch (reg) {
+    case AX_REG_FIFODATA:
+      if (emu.fifo_count == 0) {
+        emu.fifo_flags |= AX_FIFO_UNDER;
+        return 0;
+      }
+      value = emu.fifo[emu.fifo_head];
+      emu.fifo_head = (emu.fifo_head + 1) % sizeof(emu.fifo);
+      emu.fifo_count--;
+      if (emu.fifo_committed) { emu.fifo_committed--; }
+      return value;
+    case AX_REG_FIFOSTAT:
+      value = emu.fifo_flags;
+      if (emu.fifo_count == 0) { value |= AX_FIFO_EMPTY; }
+      if (emu.fifo_count == sizeof(emu.fifo)) { value |= AX_FIFO_FULL; }
+      if (emu.fifo_count > ax_emulator_thresh()) { value |= AX_FIFO_CNT_THR; }
+      if ((sizeof(emu.fifo) - emu.fifo_count) > ax_emulator_thresh()) {
+        value |= AX_FIFO_FREE_THR;
+      }
+      emu.fifo_flags = 0;       /* cleared by reading */
+      return value;
+    case AX_REG_FIFOCOUNT:    return emu.fifo_count >> 8;
+    case AX_REG_FIFOCOUNT+1:  return emu.fifo_count & 0xFF;
+    case AX_REG_FIFOFREE:     return (sizeof(emu.fifo) - emu.fifo_count) >> 8;
+    case AX_REG_FIFOFREE+1:   return (sizeof(emu.fifo) - emu.fifo_count) & 0xFF;
+    case AX_REG_IRQREQUEST:   return ax_emulator_irq_request() >> 8;
+    case AX_REG_IRQREQUEST+1: return ax_emulator_irq_request() & 0xFF;
+    case AX_REG_RADIOSTATE:
+      if ((ax_emulator_mode() == AX_PWRMODE_FULLTX) && emu.fifo_committed) {
+        return AX_RADIOSTATE_TX;
+      }
+      if (ax_emulator_mode() == AX_PWRMODE_FULLRX) {
+        return AX_RADIOSTATE_RX;
+      }
+      return AX_RADIOSTATE_IDLE;
+    default:
+      return emu.reg[reg];
+  }
+}
+/**
+ * Register write, with side effects
+ */
+static void ax_emulator_write(uint16_t reg, uint8_t value)
+{
+  switch (reg) {
+    case AX_REG_FIFODATA:
+      if (emu.fifo_count == sizeof(emu.fifo)) {
+        emu.fifo_flags |= AX_FIFO_OVER;
+        return;
+      }
+      emu.fifo[(emu.fifo_head + emu.fifo_count) % sizeof(emu.fifo)] = value;
+      emu.fifo_count++;
+      break;
+    case AX_REG_FIFOSTAT:
+      switch (value & 0x7) {
+        case AX_FIFOCMD_CLEAR_FIFO_DATA:
+          emu.fifo_count = emu.fifo_committed = 0;
+          break;
+        case AX_FIFOCMD_CLEAR_FIFO_ERROR_FLAGS:
+          emu.fifo_flags = 0;
+          break;
+        case AX_FIFOCMD_CLEAR_FIFO_DATA_AND_FLAGS:
+          emu.fifo_count = emu.fifo_committed = 0;
+          emu.fifo_flags = 0;
+          break;
+        case AX_FIFOCMD_COMMIT:
+          if (emu.fifo_committed == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &emu.tx_last);
+          }
+          emu.fifo_committed = emu.fifo_count;
+          break;
+        case AX_FIFOCMD_ROLLBACK:
+          emu.fifo_count = emu.fifo_committed;
+          break;
+      }
+      break;
+    case AX_REG_PWRMODE:
+      if (value & AX_PWRMODE_RST) {
+        ax_emulator_reset_state();
+      }
+      emu.reg[reg] = value & ~AX_PWRMODE_RST;
+      /* oscillator starts instantly */
+      emu.reg[AX_REG_XTALSTATUS] =
+        ((value & AX_PWRMODE_XOEN) || ((value & 0xF) > AX_PWRMODE_DEEPSLEEP)) ?
+        AX_XTALSTATUS_RUNNING : 0;
+      break;
+    case AX_REG_PLLRANGINGA:
+    case AX_REG_PLLRANGINGB:
+      /* ranging completes instantly, and locks */
+      emu.reg[reg] = (value & 0xF) | AX_PLLRANGING_PLL_LOCK | AX_PLLRANGING_STICKY_LOCK;
+      break;
+    default:
+      emu.reg[reg] = value;
+  }
+}
+
+/**
+ * API ----------------------------------------------------
+ */
+
+/**
+ * Returns the emulated radio to its reset state. The tx rate is kept
+ */
+void ax_emulator_reset(void)
+{
+  pthread_mutex_lock(&emu_lock);
+  ax_emulator_reset_state();
+  pthread_mutex_unlock(&emu_lock);
+}
+/**
+ * spi_transfer for an ax_config
+ */
+void ax_emulator_spi_transfer(unsigned char* data, uint8_t length)
+{
+  uint16_t status, reg;
+  uint8_t write, header, i;
+
+  if (length == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&emu_lock);
+  ax_emulator_tx_update();
+  status = ax_emulator_status();
+
+  if ((data[0] & 0x70) == 0x70) { /* long access */
+    header = 2;
+    reg = ((data[0] & 0x0F) << 8) | ((length > 1) ? data[1] : 0);
+  } else {
+    header = 1;
+    reg = data[0] & 0x7F;
+  }
+  write = data[0] & 0x80;
+
+  data[0] = status >> 8;
+  if ((header == 2) && (length > 1)) {
+    data[1] = status & 0xFF;
+  }
+
+  for (i = header; i < length; i++) {
+    if (write) {
+      ax_emulator_write(reg, data[i]);
+    } else {
+      data[i] = ax_emulator_read(reg);
+    }
+    if (reg != AX_REG_FIFODATA) { /* auto increment */
+      reg = (reg + 1) & 0xFFF;
+    }
+  }
+  ax_emulator_irq_edge();
+  pthread_mutex_unlock(&emu_lock);
+}
+/**
+ * Adds bytes to the rx fifo, for ax_emulator_rx_load/rx_packet
+ */
+static uint16_t ax_emulator_fifo_load(const uint8_t* bytes, uint16_t length)
+{
+  uint16_t i;
+
+  for (i = 0; i < length; i++) {
+    if (emu.fifo_count == sizeof(emu.fifo)) {
+      emu.fifo_flags |= AX_FIFO_OVER;
+      break;
+    }
+    emu.fifo[(emu.fifo_head + emu.fifo_count) % sizeof(emu.fifo)] = bytes[i];
+    emu.fifo_count++;
+  }
+
+  return i;
+}
+/**
+ * Adds bytes to the rx fifo, as if received
+ *
+ * Returns the number of bytes added, which is less than length if the
+ * fifo overflowed
+ */
+uint16_t ax_emulator_rx_load(const uint8_t* bytes, uint16_t length)
+{
+  uint16_t added;
+
+  pthread_mutex_lock(&emu_lock);
+  added = ax_emulator_fifo_load(bytes, length);
+  ax_emulator_irq_edge();
+  pthread_mutex_unlock(&emu_lock);
+
+  return added;
+}
+/**
+ * Adds a received packet to the rx fifo, as DATA chunks preceded by
+ * the metadata chunks PKTSTOREFLAGS asks for. Everything but the RSSI
+ * is 0
+ *
+ * Returns the number of bytes added
+ */
+uint16_t ax_emulator_rx_packet(const uint8_t* data, uint16_t length, uint8_t rssi)
+{
+  uint8_t store;
+  uint8_t chunk[4] = { 0 };
+  uint16_t added = 0, chunk_length;
+  uint8_t flags = AX_FIFO_RXDATA_PKTSTART;
+
+  pthread_mutex_lock(&emu_lock);
+  store = emu.reg[AX_REG_PKTSTOREFLAGS];
+
+  if (store & AX_PKT_STORE_TIMER) {
+    chunk[0] = AX_FIFO_CHUNK_TIMER;
+    added += ax_emulator_fifo_load(chunk, 4);
+  }
+  if (store & AX_PKT_STORE_RSSI) {
+    chunk[0] = AX_FIFO_CHUNK_RSSI;
+    chunk[1] = rssi;
+    added += ax_emulator_fifo_load(chunk, 2);
+    chunk[1] = 0;
+  }
+  if (store & AX_PKT_STORE_FREQUENCY_OFFSET) {
+    chunk[0] = AX_FIFO_CHUNK_FREQOFFS;
+    added += ax_emulator_fifo_load(chunk, 3);
+  }
+  if (store & AX_PKT_STORE_RF_OFFSET) {
+    chunk[0] = AX_FIFO_CHUNK_RFFREQOFFS;
+    added += ax_emulator_fifo_load(chunk, 4);
+  }
+  if (store & AX_PKT_STORE_DATARATE_OFFSET) {
+    chunk[0] = AX_FIFO_CHUNK_DATARATE;
+    added += ax_emulator_fifo_load(chunk, 4);
+  }
+  if (store & AX_PKT_STORE_RSSI_ON_ANTENNA_SELECT) {
+    chunk[0] = AX_FIFO_CHUNK_ANTRSSI2;
+    chunk[1] = rssi;
+    added += ax_emulator_fifo_load(chunk, 3);
+    chunk[1] = 0;
+  }
+
+  do {
+    chunk_length = MIN(length, 240);
+    length -= chunk_length;
+    if (length == 0) {
+      flags |= AX_FIFO_RXDATA_PKTEND;
+    }
+
+    chunk[0] = AX_FIFO_CHUNK_DATA;
+    chunk[1] = chunk_length + 1; /* incl flags */
+    chunk[2] = flags;
+    added += ax_emulator_fifo_load(chunk, 3);
+    added += ax_emulator_fifo_load(data, chunk_length);
+
+    data += chunk_length;
+    flags = 0;
+  } while (length);
+  ax_emulator_irq_edge();
+  pthread_mutex_unlock(&emu_lock);
+
+  return added;
+}
+/**
+ * Copies out and clears bytes sent by the transmitter
+ *
+ * Returns the number of bytes copied
+ */
+uint32_t ax_emulator_tx_read(uint8_t* buffer, uint32_t length)
+{
+  uint32_t first;
+
+  pthread_mutex_lock(&emu_lock);
+  ax_emulator_tx_update();
+
+  length = MIN(length, emu.tx_length);
+  first = MIN(length, sizeof(emu.tx) - emu.tx_head); /* up to the wrap */
+
+  memcpy(buffer, emu.tx + emu.tx_head, first);
+  memcpy(buffer + first, emu.tx, length - first);
+  emu.tx_head = (emu.tx_head + length) % sizeof(emu.tx);
+  emu.tx_length -= length;
+  pthread_mutex_unlock(&emu_lock);
+
+  return length;
+}
+/**
+ * Returns the number of sent bytes that were dropped because
+ * ax_emulator_tx_read wasn't called often enough. Reset by
+ * ax_emulator_reset
+ */
+uint32_t ax_emulator_tx_dropped(void)
+{
+  uint32_t dropped;
+
+  pthread_mutex_lock(&emu_lock);
+  dropped = emu.tx_dropped;
+  pthread_mutex_unlock(&emu_lock);
+
+  return dropped;
+}
+/**
+ * Sets how fast the transmitter empties the fifo, 0 for instantly
+ */
+void ax_emulator_set_tx_rate(uint32_t bytes_per_second)
+{
+  pthread_mutex_lock(&emu_lock);
+  emu.tx_rate = bytes_per_second;
+  pthread_mutex_unlock(&emu_lock);
+}
+/**
+ * Returns the value of a register, without side effects
+ */
+uint8_t ax_emulator_register(uint16_t reg)
+{
+  uint8_t value;
+
+  pthread_mutex_lock(&emu_lock);
+  value = emu.reg[reg & 0xFFF];
+  pthread_mutex_unlock(&emu_lock);
+
+  return value;
+}
+/**
+ * Returns the level of the IRQ pin
+ */
+uint8_t ax_emulator_irq(void)
+{
+  uint8_t pin;
+
+  pthread_mutex_lock(&emu_lock);
+  pin = ax_emulator_irq_pin();
+  pthread_mutex_unlock(&emu_lock);
+
+  return pin;
+}
+/**
+ * irq_wait for an ax_config, polls the emulated IRQ pin
+ */
+void ax_emulator_irq_wait(ax_config* config, uint32_t timeout_ms)
+{
+  struct timespec t = { 0, 100000 }; /* 100us */
+  uint32_t n = timeout_ms * 10;
+
+  (void)config;
+
+  while (!ax_emulator_irq() && n--) {
+    nanosleep(&t, NULL);
+  }
+}
+/**
+ * Watches the IRQ pin, and signals the eventfd when it rises
+ */
+static void* ax_emulator_irq_thread(void* arg)
+{
+  struct timespec t = { 0, 100000 }; /* 100us */
+
+  (void)arg;
+
+  while (!__atomic_load_n(&emu_irq.stop, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&emu_lock);
+    ax_emulator_irq_edge();
+    pthread_mutex_unlock(&emu_lock);
+    nanosleep(&t, NULL);
+  }
+
+  return NULL;
+}
+/**
+ * Opens an eventfd that is signalled on each rising edge of the IRQ
+ * pin, like a gpio line from ax_irq_open. ax_irq_wait and ax_irq_set
+ * work with it.
+ *
+ * Returns the file descriptor, or -1 on failure
+ */
+int ax_emulator_irq_open(void)
+{
+  int fd;
+
+  if (emu_irq.fd >= 0) {
+    return emu_irq.fd;          /* already open */
+  }
+
+  fd = eventfd(0, EFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&emu_lock);
+  emu_irq.fd = fd;
+  emu_irq.last = 0;
+  pthread_mutex_unlock(&emu_lock);
+
+  emu_irq.stop = 0;
+  if (pthread_create(&emu_irq.thread, NULL, ax_emulator_irq_thread, NULL)) {
+    pthread_mutex_lock(&emu_lock);
+    emu_irq.fd = -1;
+    pthread_mutex_unlock(&emu_lock);
+    close(fd);
+    return -1;
+  }
+
+  return emu_irq.fd;
+}
+/**
+ * Stops watching the IRQ pin, and closes the eventfd
+ */
+void ax_emulator_irq_close(void)
+{
+  if (emu_irq.fd < 0) {
+    return;
+  }
+
+  __atomic_store_n(&emu_irq.stop, 1, __ATOMIC_RELEASE);
+  pthread_join(emu_irq.thread, NULL);
+
+  pthread_mutex_lock(&emu_lock);
+  close(emu_irq.fd);
+  emu_irq.fd = -1;
+  pthread_mutex_unlock(&emu_lock);
+}
@@ -0,0 +1,47 @@
+/*
+ * Register level emulation of an ax5043 radio
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AX_EMULATOR_H
+#define AX_EMULATOR_H
+
+#include <stdint.h>
+
+#include "ax/ax.h"
+
+void ax_emulator_reset(void);
+void ax_emulator_spi_transfer(unsigned char* data, uint8_t length);
+
+uint16_t ax_emulator_rx_load(const uint8_t* bytes, uint16_t length);
+uint16_t ax_emulator_rx_packet(const uint8_t* data, uint16_t length, uint8_t rssi);
+uint32_t ax_emulator_tx_read(uint8_t* buffer, uint32_t length);
+uint32_t ax_emulator_tx_dropped(void);
+void ax_emulator_set_tx_rate(uint32_t bytes_per_second);
+
+uint8_t ax_emulator_register(uint16_t reg);
+uint8_t ax_emulator_irq(void);
+void ax_emulator_irq_wait(ax_config* config, uint32_t timeout_ms);
+int ax_emulator_irq_open(void);
+void ax_emulator_irq_close(void);
+
+#endif  /* AX_EMULATOR_H */
@@ -0,0 +1,171 @@
+/*
+ * IRQ line for ax radios using the linux gpio character device
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* O_CLOEXEC needs POSIX.1-2008 */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "ax_irq_linux.h"
+
+/**
+ * Requests rising edge events on a gpio line connected to the IRQ pin.
+ *
+ * Returns a file descriptor that becomes readable on each event, so it
+ * can be used with poll/epoll. -1 on failure
+ */
+int ax_irq_open(int gpiochip, int line)
+{
+  struct gpioevent_request req;
+  char path[32];
+  int fd, ret;
+
+  snprintf(path, sizeof(path), "/dev/gpiochip%d", gpiochip);
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "can't open %s\n", path);
+    return -1;
+  }
+
+  memset(&req, 0, sizeof(req));
+  req.lineoffset = line;
+  req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+  req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+  strncpy(req.consumer_label, "ax irq", sizeof(req.consumer_label) - 1);
+
+  ret = ioctl(fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+  close(fd);                    /* line fd stays valid */
+  if (ret < 0) {
+    fprintf(stderr, "can't request events on gpiochip%d line %d\n",
+            gpiochip, line);
+    return -1;
+  }
+
+  return req.fd;
+}
+/**
+ * Waits for the IRQ line to rise, and discards all pending events.
+ *
+ * The IRQ pin is level triggered, so drain the fifo before waiting.
+ * Otherwise the line may already be high and no edge will arrive.
+ *
+ * Returns 1 if signalled, 0 on timeout, -1 on error
+ */
+int ax_irq_wait(int fd, int timeout_ms)
+{
+  struct gpioevent_data event;
+  struct pollfd pfd;
+  int ret;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  do {
+    ret = poll(&pfd, 1, timeout_ms);
+  } while ((ret < 0) && (errno == EINTR));
+
+  if (ret <= 0) {
+    return ret;                 /* timeout or error */
+  }
+
+  /* discard events */
+  do {
+    if (read(fd, &event, sizeof(event)) != sizeof(event)) {
+      break;
+    }
+    pfd.revents = 0;
+  } while (poll(&pfd, 1, 0) > 0);
+
+  return 1;
+}
+/**
+ * Releases the gpio line
+ */
+void ax_irq_close(int fd)
+{
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+/**
+ * irq_wait for ax_config
+ */
+static void ax_irq_wait_config(ax_config* config, uint32_t timeout_ms)
+{
+  ax_irq_wait((int)(intptr_t)config->irq_context, timeout_ms);
+}
+/**
+ * Use this irq line while waiting for space in the tx fifo
+ */
+void ax_irq_set(ax_config* config, int fd)
+{
+  if (fd >= 0) {
+    config->irq_context = (void*)(intptr_t)fd;
+    config->irq_wait = ax_irq_wait_config;
+  } else {
+    config->irq_wait = NULL;
+  }
+}
+/**
+ * sleep_us for ax_config
+ */
+void ax_sleep_us(uint32_t us)
+{
+  struct timespec ts;
+
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+  nanosleep(&ts, NULL);
+}
+/**
+ * time_us for ax_config
+ */
+uint32_t ax_time_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+/**
+ * time_ns for ax_config
+ */
+uint64_t ax_time_ns(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
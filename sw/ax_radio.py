@@ -23,17 +23,23 @@
 from _ax_radio import lib,ffi
 from enum import Enum
 import time
+import threading
 
 class AxRadio:
     Modulations = Enum('Modulation', 'FSK MSK GFSK GMSK PSK AFSK CW')
     VcoTypes = Enum('VcoType', 'Undefined Internal Inductor External')
     RadioStates = Enum('RadioState', 'Off Transmit Receive')
+    TX_POWER_MOD = -128         # AX_TX_POWER_MOD, the modulation's power
+    RX_STREAM_START = 1         # AX_RX_STREAM_*, where a chunk is in its frame
+    RX_STREAM_END = 2
+    RX_STREAM_ABORT = 4
 
     def __init__(self,
                  spi=0, vco_type=VcoTypes.Undefined,
                  frequency_MHz=434.6, modu=Modulations.FSK,
                  bitrate=20000, fec=False, power=0.1, cont=True,
-                 accept_crc_failures=False):
+                 accept_crc_failures=False, shadow=True,
+                 irq_line=None, irq_gpiochip=0, trace=None, replay=None):
 
         self.config = ffi.new('ax_config*')
         self.mod = ffi.new('ax_modulation*')
@@ -48,6 +54,54 @@ class AxRadio:
         elif spi_status == lib.AX_SET_SPI_TRANSFER_BAD_SPI:
             raise ValueError('Bad spi number. Try 0 or 1')
 
+        # keep a shadow of the register map, skips redundant writes
+        if shadow:
+            self.shadow = ffi.new('ax_shadow*')
+            self.config.shadow = self.shadow
+
+        # irq line, so receive can sleep until there's data
+        self.irq_fd = -1
+        if irq_line is not None:
+            self.irq_fd = lib.ax_irq_open(irq_gpiochip, irq_line)
+            if self.irq_fd < 0:
+                raise RuntimeError('Failed to open IRQ line.')
+            self.config.irq_rx = 1
+            lib.ax_irq_set(self.config, self.irq_fd) # and for tx
+
+        # queue for transmit_burst
+        self.tx_queue = ffi.new('ax_tx_queue*')
+        self.config.tx_queue = self.tx_queue
+
+        # worker thread and slots for transmit_async
+        self.tx_async = ffi.new('ax_tx_async*')
+        self.async_running = False
+
+        # ring that a driver thread drains the rx fifo into, made by the
+        # first receive
+        self.rx_ring = None
+        self.rx_running = False
+        self.rx_batch = None    # for receive_packets
+
+        # record every spi transaction to a log, for ax_trace_report.py
+        self.trace = None
+        if trace:
+            self.trace = ffi.new('ax_trace*')
+            self.trace_recorder = ffi.new('ax_trace_recorder*')
+            if lib.ax_trace_record_open(self.trace, self.trace_recorder,
+                                        trace.encode()) < 0:
+                raise RuntimeError('Failed to open trace log.')
+            self.config.trace = self.trace
+
+        # or answer them from a log instead of the radio
+        self.trace_player = None
+        if replay:
+            self.trace = ffi.new('ax_trace*')
+            self.trace_player = ffi.new('ax_trace_player*')
+            if lib.ax_trace_replay_open(self.trace, self.trace_player,
+                                        replay.encode()) < 0:
+                raise RuntimeError('Failed to open replay log.')
+            self.config.trace = self.trace
+
         # default configuration for our hardware
         self.config.clock_source = lib.AX_CLOCK_SOURCE_TCXO
         self.config.f_xtal = 16369000
@@ -150,42 +204,301 @@ class AxRadio:
             self.mod.parameters.afsk.mark  = 1200
 
 
-    def transmit(self, bytes_to_transmit): # transmit
+    # power_dbm sets the power for this packet only, without writing
+    # registers. see ax_tx_power_coeffb for the range
+    def transmit(self, bytes_to_transmit, power_dbm=None): # transmit
         if self.state != self.RadioStates.Transmit:
             self.off()          # need to turn off firstn
             lib.ax_tx_on(self.config, self.mod)
             self.state = self.RadioStates.Transmit
 
-        lib.ax_tx_packet(self.config, self.mod,
-                         bytes_to_transmit, len(bytes_to_transmit))
+        if power_dbm is None:
+            lib.ax_tx_packet(self.config, self.mod,
+                             bytes_to_transmit, len(bytes_to_transmit))
+        else:
+            lib.ax_tx_packet_power(self.config, self.mod,
+                                   bytes_to_transmit, len(bytes_to_transmit),
+                                   int(power_dbm))
+
+    # transmit without waiting. done(timing) is called from another
+    # thread once the packet has been sent. don't call other methods
+    # until transmit_async_wait has returned
+    def transmit_async(self, bytes_to_transmit, done=None):
+        if self.state != self.RadioStates.Transmit:
+            self.off()          # need to turn off first
+            lib.ax_tx_on(self.config, self.mod)
+            self.state = self.RadioStates.Transmit
+
+        if not self.async_running:
+            @ffi.callback("void(uint32_t, ax_tx_timing*, void*)")
+            def async_done(packet_id, timing, context):
+                with self.async_lock:
+                    done = self.async_done.pop(packet_id, None)
+                if done:
+                    done({
+                        'enqueue_us': timing.enqueue_us,
+                        'first_byte_us': timing.first_byte_us,
+                        'idle_us': timing.idle_us,
+                    })
+            self.async_callback = async_done # keep alive
+            self.async_done = {}
+            self.async_lock = threading.Lock()
+            if lib.ax_tx_async_start(self.tx_async, self.config,
+                                     async_done, ffi.NULL) < 0:
+                raise RuntimeError('Failed to start transmit thread.')
+            self.async_running = True
+
+        if len(bytes_to_transmit) > 0x1000:
+            raise ValueError('Packet too long.')
+
+        while True:
+            with self.async_lock: # so done can't run before it's stored
+                packet_id = lib.ax_tx_async_submit(self.tx_async, self.mod,
+                                                   bytes_to_transmit,
+                                                   len(bytes_to_transmit))
+                if packet_id >= 0:
+                    self.async_done[packet_id] = done
+                    return
+            time.sleep(0.005)   # all slots in use
+
+    # wait for transmit_async packets to be sent
+    def transmit_async_wait(self):
+        if self.async_running:
+            lib.ax_tx_async_stop(self.tx_async)
+            self.async_running = False
+
+    # transmit an unframed stream until producer returns None.
+    # producer(n) returns up to n bytes, or b'' if none are ready yet.
+    # returns the number of times the producer fell behind
+    def transmit_stream(self, producer, unencoded=False):
+        if self.state != self.RadioStates.Transmit:
+            self.off()          # need to turn off first
+            lib.ax_tx_on(self.config, self.mod)
+            self.state = self.RadioStates.Transmit
 
+        @ffi.callback("int32_t(ax_tx_stream*, uint8_t*, uint16_t)")
+        def produce(stream, buf, length):
+            data = producer(length)
+            if data is None:
+                return -1       # end
+            data = data[:length]
+            ffi.memmove(buf, data, len(data))
+            return len(data)
+
+        stream = ffi.new('ax_tx_stream*')
+        stream.produce = produce
+        stream.unencoded = 1 if unencoded else 0
+        lib.ax_tx_stream_run(self.config, stream)
+
+        return stream.underruns
+
+    # reed-solomon encode, interleave to depth and transmit, all in C.
+    # decode with ax_radio.rs_decode
+    def transmit_rs(self, bytes_to_transmit, shortening=0, depth=1):
+        if self.state != self.RadioStates.Transmit:
+            self.off()          # need to turn off first
+            lib.ax_tx_on(self.config, self.mod)
+            self.state = self.RadioStates.Transmit
 
-    def receive(self, rx_func, timeout=0): # receive
-        pkt = ffi.new('ax_packet*')
+        if lib.ax_rs_tx_packet(self.config, self.mod,
+                               bytes_to_transmit, len(bytes_to_transmit),
+                               shortening, depth) < 0:
+            raise ValueError('Encoded frame too long.')
 
+    # transmit a list of packets back to back, without a gap between them
+    # packets can also be (bytes, power_dbm) tuples
+    def transmit_burst(self, packets):
+        if self.state != self.RadioStates.Transmit:
+            self.off()          # need to turn off first
+            lib.ax_tx_on(self.config, self.mod)
+            self.state = self.RadioStates.Transmit
+
+        for packet in packets:
+            if isinstance(packet, tuple):
+                packet, power_dbm = packet
+            else:
+                power_dbm = self.TX_POWER_MOD
+            lib.ax_tx_enqueue_power(self.config, self.mod,
+                                    packet, len(packet), int(power_dbm))
+        lib.ax_tx_flush(self.config)
+
+
+    # a driver thread keeps draining the fifo while rx_func runs, so a
+    # slow rx_func doesn't make the radio's fifo overflow
+    def receive(self, rx_func, timeout=0): # receive
         if self.state != self.RadioStates.Receive:
             self.off()          # need to turn off first
             lib.ax_rx_on(self.config, self.mod)
             self.state = self.RadioStates.Receive
 
+        if not self.rx_running:
+            self.rx_ring_open()
+            if lib.ax_rx_thread_start(self.config, self.rx_ring) < 0:
+                raise RuntimeError('Failed to start receive thread.')
+            self.rx_running = True
+
         start_time = time.time()
 
         while (self.state == self.RadioStates.Receive):
-            while lib.ax_rx_packet(self.config, pkt): # empty the fifo
+            pkt = lib.ax_rx_ring_peek(self.rx_ring)
+            while pkt != ffi.NULL: # empty the ring
                 data_c = ffi.cast('char*', pkt.data)
                 data = ffi.unpack(data_c[0:pkt.length], pkt.length)
-                metadata = {
-                    'rssi': pkt.rssi,
-                    'rffreqoffs': pkt.rffreqoffs,
-                }
+                metadata = self.rx_metadata(pkt)
+                length = pkt.length
+                lib.ax_rx_ring_release(self.rx_ring)
+
                 if rx_func:
-                    rx_func(data, pkt.length, metadata)
+                    rx_func(data, length, metadata)
+                if self.state != self.RadioStates.Receive:
+                    return      # rx_func changed state
+
+                pkt = lib.ax_rx_ring_peek(self.rx_ring)
 
-            time.sleep(0.025)         # 25ms sleep
+            wait = 0.5          # sleep until there's a packet
+            if timeout > 0:
+                wait = min(wait, timeout - (time.time() - start_time))
+            lib.ax_rx_ring_wait(self.rx_ring, max(int(wait * 1000), 0))
 
             if (timeout > 0) and ((time.time() - start_time) > timeout):
                 return          # timeout
 
+    # returns a list of up to max_packets received packets from one
+    # call into C. each is a memoryview over a single buffer, only
+    # valid until the next call, use bytes() to keep one. waits up to
+    # timeout seconds for the first packet, or forever if it's None.
+    # with metadata=True each entry is a (memoryview, dict) tuple, the
+    # dict as rx_metadata returns it
+    def receive_packets(self, max_packets=64, timeout=0, metadata=False):
+        if self.state != self.RadioStates.Receive:
+            self.off()          # need to turn off first
+            lib.ax_rx_on(self.config, self.mod)
+            self.state = self.RadioStates.Receive
+
+        if (self.rx_batch is None) or (len(self.rx_batch) < max_packets):
+            self.rx_batch = ffi.new('ax_packet[]', max_packets)
+            self.rx_batch_view = memoryview(ffi.buffer(self.rx_batch))
+        size = ffi.sizeof('ax_packet')
+
+        # the rx thread owns the fifo, stop it and take what it queued
+        self.receive_stop()
+        self.rx_ring_open()
+        count = 0
+        pkt = lib.ax_rx_ring_peek(self.rx_ring)
+        while (pkt != ffi.NULL) and (count < max_packets):
+            ffi.memmove(self.rx_batch + count, pkt, size)
+            lib.ax_rx_ring_release(self.rx_ring)
+            count += 1
+            pkt = lib.ax_rx_ring_peek(self.rx_ring)
+
+        timeout_ms = -1 if timeout is None else int(timeout * 1000)
+        if count:
+            timeout_ms = 0      # already have some
+        count += lib.ax_rx_packets(self.config, self.rx_batch + count,
+                                   max_packets - count, timeout_ms)
+
+        packets = []
+        for i in range(count):
+            pkt = self.rx_batch[i]
+            data = self.rx_batch_view[i*size : i*size + pkt.length]
+            if metadata:
+                packets.append((data, self.rx_metadata(pkt)))
+            else:
+                packets.append(data)
+
+        return packets
+
+    # receive frames of any length, reassembled as their chunks
+    # arrive. rx_func(data, metadata) is called with each complete
+    # frame, metadata has rssi, rffreqoffs and timestamp_ns. frames the
+    # radio aborts, or that are cut short, are dropped. timeout as for
+    # receive
+    def receive_stream(self, rx_func, timeout=0):
+        if self.state != self.RadioStates.Receive:
+            self.off()          # need to turn off first
+            lib.ax_rx_on(self.config, self.mod)
+            self.state = self.RadioStates.Receive
+
+        self.receive_stop()     # rx thread would take the fifo
+        frame = bytearray()
+
+        @ffi.callback("void(ax_rx_stream*, uint8_t*, uint16_t, uint8_t)")
+        def consume(stream, data, length, flags):
+            if flags & (self.RX_STREAM_START | self.RX_STREAM_ABORT):
+                del frame[:]
+            if flags & self.RX_STREAM_ABORT:
+                return
+            frame.extend(ffi.buffer(data, length))
+            if flags & self.RX_STREAM_END:
+                rx_func(bytes(frame), {
+                    'rssi': stream.rssi,
+                    'rffreqoffs': stream.rffreqoffs,
+                    'timestamp_ns': stream.timestamp_ns,
+                })
+
+        stream = ffi.new('ax_rx_stream*')
+        stream.consume = consume
+        start_time = time.time()
+
+        while (self.state == self.RadioStates.Receive):
+            lib.ax_rx_stream_poll(self.config, stream)
+
+            if (timeout > 0) and ((time.time() - start_time) > timeout):
+                return          # timeout
+
+            if self.irq_fd >= 0: # sleep until there's data
+                lib.ax_irq_wait(self.irq_fd, 10)
+            else:
+                time.sleep(0.001)
+
+    # metadata for a received packet. timestamp_ns is the host's
+    # CLOCK_MONOTONIC when the packet was read, the rest come from the
+    # radio. set config.pkt_store_flags before init to choose them
+    def rx_metadata(self, pkt):
+        return {
+            'rssi': pkt.rssi,
+            'rffreqoffs': pkt.rffreqoffs,
+            'freqoffs': pkt.freqoffs,
+            'antrssi': (pkt.antrssi[0], pkt.antrssi[1]),
+            'bgndnoise': pkt.bgndnoise,
+            'datarate': pkt.datarate,
+            'timer': pkt.timer,
+            'timestamp_ns': pkt.timestamp_ns,
+        }
+
+    # stops the driver thread that receive starts. packets already in
+    # the ring are kept
+    def receive_stop(self):
+        if self.rx_running:
+            lib.ax_rx_thread_stop(self.rx_ring)
+            self.rx_running = False
+
+    # makes the rx ring, if it hasn't been already
+    def rx_ring_open(self):
+        if self.rx_ring is None:
+            rx_ring = ffi.new('ax_rx_ring*')
+            if lib.ax_rx_ring_init(rx_ring) < 0:
+                raise RuntimeError('Failed to create rx ring.')
+            self.rx_ring = rx_ring
+
+    # packets dropped because the ring was full, and times the radio's
+    # fifo overflowed
+    def rx_overflows(self):
+        if self.rx_ring is None:
+            return (0, 0)
+        return (self.rx_ring.overflows, self.rx_ring.fifo_overflows)
+
+    # file descriptor that becomes readable when packets are added to
+    # the rx ring, for use with select/epoll
+    def rx_fileno(self):
+        self.rx_ring_open()
+        return self.rx_ring.fd
+
+    # file descriptor that becomes readable when the radio raises its
+    # irq line, for use with select/epoll. -1 if there's no irq line
+    def irq_fileno(self):
+        return self.irq_fd
+
     # averages 10 rf freq offsets and autotunes to them
     # only call with known good offsets (passed CRC etc.)
     def autotune(self, rffreqoffs):
@@ -208,12 +521,57 @@ class AxRadio:
             if (abs(offset) >= 5): # don't bother with < 5Hz
                 current_freq = self.config.synthesiser.A.frequency
                 updated_freq = current_freq - offset
+                # keep the rx thread off the radio
+                if self.rx_ring is not None:
+                    lib.ax_rx_thread_lock(self.rx_ring)
                 lib.ax_force_quick_adjust_frequency(self.config, updated_freq)
+                if self.rx_ring is not None:
+                    lib.ax_rx_thread_unlock(self.rx_ring)
                 print("Updated frequency by {}Hz...".format(-offset))
             # clear batch
             self.autotune_batch = []
 
+    # transmit statistics since the radio was initialised or cleared
+    def tx_stats(self):
+        stats = ffi.new('ax_tx_stats*')
+        lib.ax_tx_stats_get(self.config, stats)
+
+        return {
+            'packets': stats.packets,
+            'bytes': stats.bytes,
+            'fifo_bytes': stats.fifo_bytes,
+            'waits': stats.waits,
+            'wait_us': stats.wait_us,
+            'fifofree_min': stats.fifofree_min,
+            'starved': stats.starved,
+            'underruns': stats.underruns,
+            'overruns': stats.overruns,
+            'airtime_us': stats.airtime_us,
+            'wall_us': stats.wall_us,
+        }
+
+    def tx_stats_clear(self):
+        lib.ax_tx_stats_clear(self.config)
+
+    # switch between transmit and receive without turning off. returns
+    # the time taken in us
+    def turnaround(self):
+        self.transmit_async_wait()
+        self.receive_stop()
+        if self.state == self.RadioStates.Transmit:
+            us = lib.ax_turnaround_rx(self.config, self.mod)
+            self.state = self.RadioStates.Receive
+        elif self.state == self.RadioStates.Receive:
+            us = lib.ax_turnaround_tx(self.config, self.mod)
+            self.state = self.RadioStates.Transmit
+        else:
+            raise RuntimeError('Radio is off.')
+
+        return us
+
     def off(self):              # off
+        self.transmit_async_wait()
+        self.receive_stop()
         if self.state != self.RadioStates.Off:
             lib.ax_off(self.config)
             self.state = self.RadioStates.Off
@@ -221,6 +579,47 @@ class AxRadio:
     def get_modulation(self):       # getter
         return self.mod
 
+    # stops the transmit and receive threads, and frees the rx ring and
+    # irq line. the radio itself is left as it is
+    def close(self):
+        if getattr(self, 'tx_async', None) is not None:
+            self.transmit_async_wait()
+        if getattr(self, 'rx_ring', None) is not None:
+            self.receive_stop()
+            lib.ax_rx_ring_close(self.rx_ring)
+            self.rx_ring = None
+        if getattr(self, 'irq_fd', -1) >= 0:
+            lib.ax_irq_set(self.config, -1)
+            lib.ax_irq_close(self.irq_fd)
+            self.irq_fd = -1
+
+    def __del__(self):
+        self.close()
+
+    # finish the trace log. when replaying, returns the number of
+    # transactions that differed from the log
+    def trace_close(self):
+        if self.trace_player:
+            return lib.ax_trace_replay_close(self.trace)
+        if self.trace:
+            lib.ax_trace_record_close(self.trace)
+        return 0
+
+"""
+Deinterleaves and reed-solomon decodes a frame from transmit_rs.
+Returns (data, bytes corrected), or (None, -1) if it can't be corrected
+"""
+def rs_decode(frame, shortening=0, depth=1):
+    data = ffi.new('uint8_t[]', max(len(frame), 1))
+    data_length = ffi.new('uint16_t*')
+
+    corrected = lib.ax_rs_decode(frame, len(frame), shortening, depth,
+                                 data, data_length)
+    if corrected < 0:
+        return (None, -1)
+
+    return (ffi.unpack(ffi.cast('char*', data), data_length[0]), corrected)
+
 
 """
 GMSK-{X,Y,Z} modes
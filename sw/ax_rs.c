@@ -0,0 +1,212 @@
+/*
+ * Reed-Solomon coding and interleaving of ax radio frames
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ax/ax.h"
+#include "rs8/rs8.h"
+#include "ax_rs.h"
+
+/**
+ * Data is split into as few blocks of up to 223-shortening bytes as
+ * it fits in, all within a byte of each other in length. Each block
+ * becomes a codeword with 32 parity bytes after it.
+ *
+ * Codewords are interleaved in groups of at least depth (or all of
+ * them, if there are fewer): the frame is the first byte of each
+ * codeword in the group, then the second byte of each, and so on. The
+ * longer codewords come first, so only the last column of a group can
+ * be short. Any burst of 16*depth bytes then hits each codeword at most
+ * 16 times, as long as there are depth codewords.
+ */
+
+/**
+ * Layout of one codeword in the frame
+ */
+typedef struct ax_rs_codeword {
+  uint16_t group_start;         /* offset of its group in the frame */
+  uint16_t rows;                /* codewords in its group */
+  uint16_t row;                 /* its index in the group */
+  uint8_t length;               /* its length */
+} ax_rs_codeword;
+
+/**
+ * Finds where codeword index of blocks sits in a frame of
+ * frame_length bytes
+ */
+static void ax_rs_layout(ax_rs_codeword* cw, uint16_t index, uint16_t blocks,
+                         uint16_t frame_length, uint8_t depth)
+{
+  uint16_t groups = (blocks / depth) ? (blocks / depth) : 1;
+  uint16_t rows = blocks / groups;
+  uint16_t big_groups = blocks % groups; /* groups with one more row */
+  uint16_t big_rows = big_groups * (rows + 1);
+  uint8_t short_length = frame_length / blocks;
+  uint16_t long_count = frame_length % blocks; /* one byte longer */
+  uint16_t first;
+
+  if (index < big_rows) {
+    cw->rows = rows + 1;
+    first = index - (index % cw->rows);
+  } else {
+    cw->rows = rows;
+    first = index - ((index - big_rows) % rows);
+  }
+
+  cw->group_start = (first * short_length) +
+    ((first < long_count) ? first : long_count);
+  cw->row = index - first;
+  cw->length = short_length + ((index < long_count) ? 1 : 0);
+}
+/**
+ * Offset in the frame of byte i of a codeword
+ */
+static uint16_t ax_rs_position(ax_rs_codeword* cw, uint8_t i)
+{
+  return cw->group_start + (i * cw->rows) + cw->row;
+}
+/**
+ * Length of the frame that ax_rs_encode makes from length bytes
+ */
+uint32_t ax_rs_encoded_length(uint16_t length, uint8_t shortening)
+{
+  uint8_t k = AX_RS_K - shortening;
+
+  if (shortening >= AX_RS_K) { return 0; }
+
+  return length + ((uint32_t)((length + k - 1) / k) * AX_RS_PARITY);
+}
+/**
+ * Encodes length bytes of data into frame, RS(255,223) shortened by
+ * shortening bytes and interleaved to depth (0 or 1 for none).
+ *
+ * Returns the frame length, or -1 if it doesn't fit in frame_size
+ */
+int32_t ax_rs_encode(uint8_t* data, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* frame, uint16_t frame_size)
+{
+  uint8_t codeword[AX_RS_N];
+  ax_rs_codeword cw;
+  uint8_t k = AX_RS_K - shortening;
+  uint32_t frame_length = ax_rs_encoded_length(length, shortening);
+  uint16_t blocks, b;
+  uint8_t i;
+
+  if ((shortening >= AX_RS_K) || (length == 0) ||
+      (frame_length > frame_size)) {
+    return -1;
+  }
+  blocks = (length + k - 1) / k;
+  if (depth == 0) { depth = 1; }
+
+  for (b = 0; b < blocks; b++) {
+    ax_rs_layout(&cw, b, blocks, frame_length, depth);
+
+    /* encode */
+    memcpy(codeword, data, cw.length - AX_RS_PARITY);
+    encode_rs_8(codeword, codeword + cw.length - AX_RS_PARITY,
+                AX_RS_N - cw.length);
+    data += cw.length - AX_RS_PARITY;
+
+    /* interleave */
+    for (i = 0; i < cw.length; i++) {
+      frame[ax_rs_position(&cw, i)] = codeword[i];
+    }
+  }
+
+  return frame_length;
+}
+/**
+ * Deinterleaves and decodes a frame from ax_rs_encode, with the same
+ * shortening and depth. data must have room for length bytes.
+ *
+ * Returns the number of bytes corrected, or -1 if any codeword can't be
+ * corrected or the frame length isn't possible
+ */
+int32_t ax_rs_decode(uint8_t* frame, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* data, uint16_t* data_length)
+{
+  uint8_t codeword[AX_RS_N];
+  ax_rs_codeword cw;
+  uint8_t n = AX_RS_N - shortening;
+  uint16_t blocks = (length + n - 1) / n;
+  uint8_t last_n = length - ((blocks - 1) * n);
+  int32_t corrected = 0;
+  int errors;
+  uint16_t b;
+  uint8_t i;
+
+  if ((shortening >= AX_RS_K) || (length == 0) || (last_n <= AX_RS_PARITY)) {
+    return -1;                  /* can't have come from ax_rs_encode */
+  }
+  if (depth == 0) { depth = 1; }
+
+  *data_length = 0;
+
+  for (b = 0; b < blocks; b++) {
+    ax_rs_layout(&cw, b, blocks, length, depth);
+
+    /* deinterleave */
+    for (i = 0; i < cw.length; i++) {
+      codeword[i] = frame[ax_rs_position(&cw, i)];
+    }
+
+    /* decode */
+    errors = decode_rs_8(codeword, NULL, 0, AX_RS_N - cw.length);
+    if (errors < 0) {
+      return -1;
+    }
+    corrected += errors;
+
+    memcpy(data + *data_length, codeword, cw.length - AX_RS_PARITY);
+    *data_length += cw.length - AX_RS_PARITY;
+  }
+
+  return corrected;
+}
+/**
+ * Encodes data with ax_rs_encode and transmits it as one packet
+ *
+ * Returns the frame length, or -1 if it is longer than AX_RS_MAX_FRAME
+ */
+int32_t ax_rs_tx_packet(ax_config* config, ax_modulation* mod,
+                        uint8_t* data, uint16_t length,
+                        uint8_t shortening, uint8_t depth)
+{
+  uint8_t frame[AX_RS_MAX_FRAME];
+  int32_t frame_length;
+
+  frame_length = ax_rs_encode(data, length, shortening, depth,
+                              frame, sizeof(frame));
+  if (frame_length < 0) {
+    return -1;
+  }
+
+  ax_tx_packet(config, mod, frame, frame_length);
+
+  return frame_length;
+}
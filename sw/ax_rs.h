@@ -0,0 +1,50 @@
+/*
+ * Reed-Solomon coding and interleaving of ax radio frames
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AX_RS_H
+#define AX_RS_H
+
+#include <stdint.h>
+
+#include "ax/ax.h"
+
+/* RS(255,223) */
+#define AX_RS_N			255
+#define AX_RS_K			223
+#define AX_RS_PARITY		(AX_RS_N - AX_RS_K)
+/* longest frame ax_rs_tx_packet sends */
+#define AX_RS_MAX_FRAME		0x1000
+
+uint32_t ax_rs_encoded_length(uint16_t length, uint8_t shortening);
+int32_t ax_rs_encode(uint8_t* data, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* frame, uint16_t frame_size);
+int32_t ax_rs_decode(uint8_t* frame, uint16_t length,
+                     uint8_t shortening, uint8_t depth,
+                     uint8_t* data, uint16_t* data_length);
+int32_t ax_rs_tx_packet(ax_config* config, ax_modulation* mod,
+                        uint8_t* data, uint16_t length,
+                        uint8_t shortening, uint8_t depth);
+
+#endif  /* AX_RS_H */
@@ -0,0 +1,264 @@
+/*
+ * Receive thread and packet ring for ax radios
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* for nanosleep */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "ax/ax.h"
+#include "ax_rx_ring.h"
+
+/**
+ * RING -------------------------------------------------
+ */
+
+/**
+ * Prepares an empty ring. Returns 0 on success
+ */
+int ax_rx_ring_init(ax_rx_ring* ring)
+{
+  ring->head = ring->tail = 0;
+  ring->packets = ring->overflows = ring->fifo_overflows = 0;
+  ring->running = 0;
+
+  if (pthread_mutex_init(&ring->lock, NULL)) {
+    return -1;
+  }
+
+  ring->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ring->fd < 0) {
+    pthread_mutex_destroy(&ring->lock);
+    return -1;
+  }
+
+  return 0;
+}
+/**
+ * Frees the eventfd and lock. Stop the rx thread first
+ */
+void ax_rx_ring_close(ax_rx_ring* ring)
+{
+  if (ring->fd >= 0) {
+    close(ring->fd);
+    ring->fd = -1;
+    pthread_mutex_destroy(&ring->lock);
+  }
+}
+/**
+ * The oldest packet in the ring, or NULL if it's empty. The packet
+ * stays in its slot until ax_rx_ring_release
+ */
+ax_packet* ax_rx_ring_peek(ax_rx_ring* ring)
+{
+  uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  if (ring->tail == head) {
+    return NULL;
+  }
+
+  return &ring->slot[ring->tail % AX_RX_RING_SLOTS];
+}
+/**
+ * Hands the oldest slot back to the rx thread
+ */
+void ax_rx_ring_release(ax_rx_ring* ring)
+{
+  if (ring->tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+  }
+}
+/**
+ * Number of packets waiting in the ring
+ */
+uint32_t ax_rx_ring_count(ax_rx_ring* ring)
+{
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+}
+/**
+ * Waits up to timeout_ms for a packet, or forever if it's negative.
+ * ring->fd can be used with poll/epoll instead.
+ *
+ * Returns 1 if there are packets in the ring, 0 on timeout, -1 on error
+ */
+int ax_rx_ring_wait(ax_rx_ring* ring, int timeout_ms)
+{
+  struct pollfd pfd;
+  uint64_t events;
+  int ret;
+
+  pfd.fd = ring->fd;
+  pfd.events = POLLIN;
+
+  while (!ax_rx_ring_count(ring)) {
+    pfd.revents = 0;
+
+    do {
+      ret = poll(&pfd, 1, timeout_ms);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret <= 0) {
+      return ret;               /* timeout or error */
+    }
+
+    /* reset the eventfd, then check the ring again */
+    if (read(ring->fd, &events, sizeof(events)) < 0) {
+      /* already reset */
+    }
+  }
+
+  return 1;
+}
+
+/**
+ * THREAD -------------------------------------------------
+ */
+
+/**
+ * Moves every packet in the fifo into the ring. Returns the number
+ * added.
+ *
+ * Called with the lock held
+ */
+static uint32_t ax_rx_thread_drain(ax_rx_ring* ring)
+{
+  ax_packet* pkt;
+  uint32_t head = ring->head;
+  uint32_t added = 0;
+  uint8_t full;
+
+  while (1) {
+    full = ((head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) ==
+            AX_RX_RING_SLOTS);
+    pkt = full ? &ring->spare : &ring->slot[head % AX_RX_RING_SLOTS];
+
+    if (!ax_rx_packet(ring->config, pkt)) {
+      break;                    /* fifo empty */
+    }
+
+    if (full) {                 /* keep draining, but drop it */
+      ring->overflows++;
+    } else {
+      head++;
+      __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+      ring->packets++;
+      added++;
+    }
+  }
+
+  /* the radio's fifo overflowed, and ax_rx_packet cleared it */
+  ring->fifo_overflows +=
+    ring->config->state.fifo_rx_overflows - ring->fifo_rx_overflows;
+  ring->fifo_rx_overflows = ring->config->state.fifo_rx_overflows;
+
+  return added;
+}
+/**
+ * Rx thread
+ */
+static void* ax_rx_thread_worker(void* arg)
+{
+  ax_rx_ring* ring = arg;
+  struct timespec poll = { 0, 1000000 }; /* 1ms */
+  uint64_t one = 1;
+  uint32_t added;
+
+  while (!__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&ring->lock);
+    added = ax_rx_thread_drain(ring);
+    pthread_mutex_unlock(&ring->lock);
+
+    if (added) {                /* wake the consumer */
+      if (write(ring->fd, &one, sizeof(one)) < 0) {
+        /* counter full, it's readable anyhow */
+      }
+    }
+
+    /* sleep until the radio has data */
+    if (ring->config->irq_rx && ring->config->irq_wait) {
+      ring->config->irq_wait(ring->config, 10);
+    } else {
+      nanosleep(&poll, NULL);
+    }
+  }
+
+  return NULL;
+}
+/**
+ * Starts a thread that moves received packets into ring, which must
+ * have been through ax_rx_ring_init. The radio must already be
+ * receiving (ax_rx_on), and the thread owns it until
+ * ax_rx_thread_stop. Use ax_rx_thread_lock to use the radio in the
+ * meantime.
+ *
+ * Returns 0 on success, or -1 if the ring already has a thread
+ */
+int ax_rx_thread_start(ax_config* config, ax_rx_ring* ring)
+{
+  if (ring->running) {
+    return -1;
+  }
+
+  ring->config = config;
+  ring->fifo_rx_overflows = config->state.fifo_rx_overflows;
+  ring->stop = 0;
+
+  if (pthread_create(&ring->thread, NULL, ax_rx_thread_worker, ring)) {
+    return -1;
+  }
+  ring->running = 1;
+
+  return 0;
+}
+/**
+ * Stops the rx thread. Packets already in the ring stay there
+ */
+void ax_rx_thread_stop(ax_rx_ring* ring)
+{
+  if (!ring->running) {
+    return;
+  }
+
+  __atomic_store_n(&ring->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(ring->thread, NULL);
+  ring->running = 0;
+}
+/**
+ * Keeps the rx thread off the radio, so it can be used from another
+ * thread. Hold it as briefly as possible, the fifo fills meanwhile
+ */
+void ax_rx_thread_lock(ax_rx_ring* ring)
+{
+  pthread_mutex_lock(&ring->lock);
+}
+void ax_rx_thread_unlock(ax_rx_ring* ring)
+{
+  pthread_mutex_unlock(&ring->lock);
+}
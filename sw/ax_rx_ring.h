@@ -0,0 +1,76 @@
+/*
+ * Receive thread and packet ring for ax radios
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AX_RX_RING_H
+#define AX_RX_RING_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ax/ax.h"
+
+/* must be a power of two */
+#define AX_RX_RING_SLOTS	64
+
+/**
+ * Received packets, passed from the rx thread to one consumer without
+ * locks. Slots from tail to head hold packets. Both indexes only ever
+ * increase: head is only written by the rx thread, tail only by the
+ * consumer.
+ *
+ * Each ring has its own rx thread, which owns one radio while it
+ * runs.
+ */
+typedef struct ax_rx_ring {
+  ax_packet slot[AX_RX_RING_SLOTS];
+  uint32_t head;                /* next slot the rx thread fills */
+  uint32_t tail;                /* oldest slot the consumer holds */
+  uint32_t packets;             /* packets put in the ring */
+  uint32_t overflows;           /* packets dropped as the ring was full */
+  uint32_t fifo_overflows;      /* times the radio's fifo overflowed */
+  int fd;                       /* eventfd, readable when packets arrive */
+
+  /* rx thread */
+  ax_config* config;
+  ax_packet spare;              /* receives packets when the ring is full */
+  uint32_t fifo_rx_overflows;   /* config->state.fifo_rx_overflows seen */
+  pthread_t thread;
+  pthread_mutex_t lock;         /* held while using the radio */
+  int running;
+  int stop;
+} ax_rx_ring;
+
+int ax_rx_ring_init(ax_rx_ring* ring);
+void ax_rx_ring_close(ax_rx_ring* ring);
+ax_packet* ax_rx_ring_peek(ax_rx_ring* ring);
+void ax_rx_ring_release(ax_rx_ring* ring);
+uint32_t ax_rx_ring_count(ax_rx_ring* ring);
+int ax_rx_ring_wait(ax_rx_ring* ring, int timeout_ms);
+
+int ax_rx_thread_start(ax_config* config, ax_rx_ring* ring);
+void ax_rx_thread_stop(ax_rx_ring* ring);
+void ax_rx_thread_lock(ax_rx_ring* ring);
+void ax_rx_thread_unlock(ax_rx_ring* ring);
+
+#endif  /* AX_RX_RING_H */
@@ -0,0 +1,272 @@
+/*
+ * Record and replay spi transactions for ax radios
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* for clock_gettime */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "ax/ax.h"
+#include "ax_trace.h"
+
+/**
+ * RECORD -------------------------------------------------
+ */
+
+static void ax_trace_put_16(FILE* f, uint16_t value)
+{
+  fputc(value & 0xFF, f);
+  fputc(value >> 8, f);
+}
+static void ax_trace_put_32(FILE* f, uint32_t value)
+{
+  ax_trace_put_16(f, value & 0xFFFF);
+  ax_trace_put_16(f, value >> 16);
+}
+/**
+ * Microseconds since recording started
+ */
+static uint32_t ax_trace_time_us(ax_trace_recorder* rec)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return ((now.tv_sec - rec->start.tv_sec) * 1000000) +
+    ((now.tv_nsec - rec->start.tv_nsec) / 1000);
+}
+/**
+ * record for ax_trace
+ */
+static void ax_trace_record(ax_trace* trace, unsigned char* sent,
+                            unsigned char* received, uint8_t length)
+{
+  ax_trace_recorder* rec = trace->context;
+  uint8_t kind = 0;
+  uint16_t reg, status;
+  uint8_t header;
+
+  if (length == 0) {
+    return;
+  }
+
+  if ((sent[0] & 0x70) == 0x70) { /* long access */
+    kind |= AX_TRACE_LONG;
+    header = 2;
+    reg = ((sent[0] & 0x0F) << 8) | sent[1];
+    status = (received[0] << 8) | received[1];
+  } else {
+    header = 1;
+    reg = sent[0] & 0x7F;
+    status = received[0] << 8;
+  }
+  if (sent[0] & 0x80) {
+    kind |= AX_TRACE_WRITE;
+  }
+  if (length < header) {        /* no room for a full address */
+    header = length;
+  }
+
+  fputc(kind, rec->file);
+  ax_trace_put_32(rec->file, ax_trace_time_us(rec));
+  ax_trace_put_16(rec->file, reg);
+  ax_trace_put_16(rec->file, status);
+  fputc(length - header, rec->file);
+  fwrite(((kind & AX_TRACE_WRITE) ? sent : received) + header,
+         1, length - header, rec->file);
+}
+/**
+ * call for ax_trace
+ */
+static void ax_trace_call(ax_trace* trace, const char* name)
+{
+  ax_trace_recorder* rec = trace->context;
+  uint8_t length = strlen(name);
+
+  fputc(AX_TRACE_CALL, rec->file);
+  fputc(length, rec->file);
+  fwrite(name, 1, length, rec->file);
+}
+/**
+ * Starts recording every transaction to the log at path, using rec
+ * until ax_trace_record_close.
+ *
+ * Set config->trace to trace after this call. Returns 0 on success
+ */
+int ax_trace_record_open(ax_trace* trace, ax_trace_recorder* rec,
+                         const char* path)
+{
+  rec->file = fopen(path, "wb");
+  if (!rec->file) {
+    fprintf(stderr, "can't open %s\n", path);
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &rec->start);
+
+  memset(trace, 0, sizeof(ax_trace));
+  trace->record = ax_trace_record;
+  trace->call = ax_trace_call;
+  trace->context = rec;
+
+  return 0;
+}
+/**
+ * Stops recording
+ */
+void ax_trace_record_close(ax_trace* trace)
+{
+  ax_trace_recorder* rec = trace->context;
+
+  if (rec && rec->file) {
+    fclose(rec->file);
+    rec->file = NULL;
+  }
+}
+
+/**
+ * REPLAY -------------------------------------------------
+ */
+
+static uint16_t ax_trace_get_16(FILE* f)
+{
+  uint16_t value = fgetc(f) & 0xFF;
+  return value | ((fgetc(f) & 0xFF) << 8);
+}
+/**
+ * Reports a transaction that doesn't match the log
+ */
+static void ax_trace_mismatch(ax_trace_player* player, const char* what)
+{
+  if (player->mismatches++ == 0) { /* only report the first */
+    fprintf(stderr, "replay: transaction %u differs from log (%s)\n",
+            player->index, what);
+  }
+}
+/**
+ * transfer for ax_trace. Answers each transaction from the log, and
+ * checks it matches what was recorded
+ */
+static void ax_trace_replay_transfer(ax_trace* trace, unsigned char* data,
+                                     uint8_t length)
+{
+  ax_trace_player* player = trace->context;
+  unsigned char logged[0x100];
+  uint8_t kind = 0, header, n;
+  uint16_t reg, status;
+  int c;
+
+  if (!player->file) {          /* closed */
+    memset(data, 0, length);
+    return;
+  }
+
+  /* skip call records */
+  while (((c = fgetc(player->file)) != EOF) && (c & AX_TRACE_CALL)) {
+    n = fgetc(player->file);
+    fseek(player->file, n, SEEK_CUR);
+  }
+  if (c == EOF) {
+    ax_trace_mismatch(player, "end of log");
+    memset(data, 0, length);
+    player->index++;
+    return;
+  }
+  kind = c;
+
+  fseek(player->file, 4, SEEK_CUR); /* time */
+  reg = ax_trace_get_16(player->file);
+  status = ax_trace_get_16(player->file);
+  n = fgetc(player->file);
+  if (fread(logged, 1, n, player->file) != n) {
+    ax_trace_mismatch(player, "truncated log");
+  }
+
+  /* check request */
+  header = (kind & AX_TRACE_LONG) ? 2 : 1;
+  if ((((data[0] & 0x70) == 0x70) != ((kind & AX_TRACE_LONG) != 0)) ||
+      (((data[0] & 0x80) != 0) != ((kind & AX_TRACE_WRITE) != 0))) {
+    ax_trace_mismatch(player, "access type");
+  } else if (reg != ((header == 2) ?
+                     (((data[0] & 0x0F) << 8) | data[1]) : (data[0] & 0x7F))) {
+    ax_trace_mismatch(player, "register");
+  } else if ((length - header) != n) {
+    ax_trace_mismatch(player, "length");
+  } else if ((kind & AX_TRACE_WRITE) && memcmp(data + header, logged, n)) {
+    ax_trace_mismatch(player, "data written");
+  }
+
+  /* answer */
+  if (!(kind & AX_TRACE_WRITE) && (length > header)) {
+    memcpy(data + header, logged, (n < (length - header)) ? n : (length - header));
+  }
+  data[0] = status >> 8;
+  if ((header == 2) && (length > 1)) {
+    data[1] = status & 0xFF;
+  }
+
+  player->index++;
+}
+/**
+ * Opens a log for replay, using player until ax_trace_replay_close.
+ * Set config->trace to trace after this call, and it answers every
+ * transaction in place of the radio. Start from the same calls that
+ * were recorded.
+ *
+ * Returns 0 on success
+ */
+int ax_trace_replay_open(ax_trace* trace, ax_trace_player* player,
+                         const char* path)
+{
+  player->file = fopen(path, "rb");
+  if (!player->file) {
+    fprintf(stderr, "can't open %s\n", path);
+    return -1;
+  }
+  player->index = 0;
+  player->mismatches = 0;
+
+  memset(trace, 0, sizeof(ax_trace));
+  trace->transfer = ax_trace_replay_transfer;
+  trace->context = player;
+
+  return 0;
+}
+/**
+ * Finishes replay. Transactions after this are answered with zeros.
+ *
+ * Returns the number of transactions that didn't match the log
+ */
+uint32_t ax_trace_replay_close(ax_trace* trace)
+{
+  ax_trace_player* player = trace->context;
+
+  if (player->file) {
+    fclose(player->file);
+    player->file = NULL;
+  }
+
+  return player->mismatches;
+}
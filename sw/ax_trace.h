@@ -0,0 +1,71 @@
+/*
+ * Record and replay spi transactions for ax radios
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AX_TRACE_H
+#define AX_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "ax/ax.h"
+
+/**
+ * Log format. All values little endian. Each record starts with a
+ * kind byte:
+ *
+ * transaction: kind, time_us (4), reg (2), status (2), n (1), data (n)
+ *   data is the bytes written for a write, or returned for a read.
+ *   status is only the top byte for a short access.
+ * call: kind, name length (1), name
+ */
+#define AX_TRACE_WRITE	(1 << 0)
+#define AX_TRACE_LONG	(1 << 1)
+#define AX_TRACE_CALL	(1 << 7)
+
+/**
+ * A log being written, one per trace
+ */
+typedef struct ax_trace_recorder {
+  FILE* file;
+  struct timespec start;
+} ax_trace_recorder;
+
+/**
+ * A log being replayed, one per trace
+ */
+typedef struct ax_trace_player {
+  FILE* file;
+  uint32_t index;               /* transactions replayed */
+  uint32_t mismatches;          /* transactions that differed */
+} ax_trace_player;
+
+int ax_trace_record_open(ax_trace* trace, ax_trace_recorder* rec,
+                         const char* path);
+void ax_trace_record_close(ax_trace* trace);
+
+int ax_trace_replay_open(ax_trace* trace, ax_trace_player* player,
+                         const char* path);
+uint32_t ax_trace_replay_close(ax_trace* trace);
+
+#endif  /* AX_TRACE_H */
@@ -0,0 +1,70 @@
+# Report spi transactions per API call from an ax trace log
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+import struct
+import sys
+from collections import OrderedDict
+
+AX_TRACE_WRITE = 1 << 0
+AX_TRACE_CALL  = 1 << 7
+
+def read_log(path):
+    """yields ('call', name) and ('xfer', kind, time_us, reg, status, data)"""
+    with open(path, 'rb') as f:
+        log = bytearray(f.read())
+    i = 0
+    while i < len(log):
+        kind = log[i]
+        if kind & AX_TRACE_CALL:
+            n = log[i+1]
+            yield ('call', log[i+2:i+2+n].decode('ascii'))
+            i += 2 + n
+        else:
+            time_us, reg, status, n = struct.unpack_from('<IHHB', log, i+1)
+            yield ('xfer', kind, time_us, reg, status, log[i+10:i+10+n])
+            i += 10 + n
+
+def report(path):
+    # per call name: [calls, transactions, bytes, writes, reads]
+    totals = OrderedDict()
+    current = None
+    for record in read_log(path):
+        if record[0] == 'call':
+            current = record[1]
+            totals.setdefault(current, [0, 0, 0, 0, 0])[0] += 1
+        else:
+            kind, data = record[1], record[5]
+            t = totals.setdefault(current or '(none)', [0, 0, 0, 0, 0])
+            t[1] += 1
+            t[2] += len(data) + (2 if kind & 2 else 1)
+            t[3 if kind & AX_TRACE_WRITE else 4] += 1
+
+    print('{:<34} {:>7} {:>8} {:>9} {:>8} {:>7}'.format(
+        'call', 'calls', 'xfers', 'bytes', 'writes', 'reads'))
+    for name, t in totals.items():
+        print('{:<34} {:>7} {:>8} {:>9} {:>8} {:>7}'.format(name, *t))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print('usage: {} <trace log>'.format(sys.argv[0]))
+        sys.exit(1)
+    report(sys.argv[1])
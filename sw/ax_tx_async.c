@@ -0,0 +1,245 @@
+/*
+ * Asynchronous transmit for ax radios
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* for clock_gettime and nanosleep */
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ax/ax.h"
+#include "ax_tx_async.h"
+
+/**
+ * Microseconds on CLOCK_MONOTONIC
+ */
+static uint64_t ax_tx_async_time_us(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return ((uint64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+/**
+ * Writes a waiting packet to the fifo
+ */
+static void ax_tx_async_send(ax_tx_async* async, ax_tx_async_slot* slot)
+{
+  ax_config* config = async->config;
+
+  /* the dequeue time, if there's no time_ns to say when the write was */
+  slot->timing.first_byte_us = ax_tx_async_time_us();
+
+  ax_tx_packet(config, slot->mod, slot->data, slot->length);
+
+  if (config->time_ns) {
+    slot->timing.first_byte_us = config->state.fifo_tx_time_ns / 1000;
+  }
+  slot->fifo_end = config->state.fifo_tx_written;
+}
+/**
+ * Reports packets that have left the fifo as done. The newest packet
+ * isn't done until the transmitter is idle, as it might still be in
+ * the tail.
+ *
+ * Called with the lock held, which is released for spi and callbacks
+ */
+static void ax_tx_async_complete(ax_tx_async* async)
+{
+  ax_tx_async_slot* slot;
+  uint32_t fifo_sent;
+  uint64_t now_us;
+  int idle;
+
+  if (async->done == async->sent) {
+    return;                     /* nothing in the fifo */
+  }
+
+  pthread_mutex_unlock(&async->lock);
+  fifo_sent = ax_tx_fifo_sent(async->config);
+  idle = ax_tx_complete(async->config);
+  now_us = ax_tx_async_time_us();
+  pthread_mutex_lock(&async->lock);
+
+  while (async->done != async->sent) {
+    slot = &async->slot[async->done % AX_TX_ASYNC_SLOTS];
+
+    if ((int32_t)(fifo_sent - slot->fifo_end) < 0) {
+      break;                    /* still in the fifo */
+    }
+    if (((async->done + 1) == async->sent) && !idle) {
+      break;                    /* still transmitting */
+    }
+    slot->timing.idle_us = now_us;
+
+    /* callbacks may submit, so call them without the lock */
+    if (async->done_callback) {
+      pthread_mutex_unlock(&async->lock);
+      async->done_callback(slot->id, &slot->timing, async->context);
+      pthread_mutex_lock(&async->lock);
+    }
+    async->done++;              /* slot is free */
+  }
+}
+/**
+ * Worker thread
+ */
+static void* ax_tx_async_worker(void* arg)
+{
+  ax_tx_async* async = arg;
+  struct timespec poll = { 0, 1000000 }; /* 1ms */
+  ax_tx_async_slot* slot;
+
+  pthread_mutex_lock(&async->lock);
+
+  while (1) {
+    ax_tx_async_complete(async);
+
+    if (async->submitted != async->sent) { /* waiting packet */
+      slot = &async->slot[async->sent % AX_TX_ASYNC_SLOTS];
+
+      /* the slot isn't reused until it is done */
+      pthread_mutex_unlock(&async->lock);
+      ax_tx_async_send(async, slot);
+      pthread_mutex_lock(&async->lock);
+
+      async->sent++;
+
+    } else if (async->sent != async->done) { /* packets in the fifo */
+      pthread_mutex_unlock(&async->lock);
+      nanosleep(&poll, NULL);
+      pthread_mutex_lock(&async->lock);
+
+    } else if (async->stop) {   /* everything done */
+      break;
+
+    } else {
+      pthread_cond_wait(&async->wake, &async->lock);
+    }
+  }
+
+  pthread_mutex_unlock(&async->lock);
+
+  return NULL;
+}
+/**
+ * Starts a worker thread that transmits submitted packets. The radio
+ * must already be in FULLTX (ax_tx_on), and the worker owns it until
+ * ax_tx_async_stop returns. One worker per async, and per config.
+ *
+ * done is called from the worker thread once each packet has left the
+ * fifo, or for the last packet in a burst once the transmitter is
+ * idle. done may be NULL.
+ *
+ * Returns 0 on success
+ */
+int ax_tx_async_start(ax_tx_async* async, ax_config* config,
+                      ax_tx_async_done done, void* context)
+{
+  if (async->running) {
+    return -1;
+  }
+
+  if (pthread_mutex_init(&async->lock, NULL)) {
+    return -1;
+  }
+  if (pthread_cond_init(&async->wake, NULL)) {
+    pthread_mutex_destroy(&async->lock);
+    return -1;
+  }
+
+  async->config = config;
+  async->done_callback = done;
+  async->context = context;
+  async->stop = 0;
+  async->submitted = async->sent = async->done = 0;
+
+  if (pthread_create(&async->thread, NULL, ax_tx_async_worker, async)) {
+    pthread_cond_destroy(&async->wake);
+    pthread_mutex_destroy(&async->lock);
+    return -1;
+  }
+  async->running = 1;
+
+  return 0;
+}
+/**
+ * Submits a packet, which is copied. Returns at once.
+ *
+ * Returns an id that will be passed to done, or -1 if the packet is
+ * too long or all slots are in use
+ */
+int32_t ax_tx_async_submit(ax_tx_async* async, ax_modulation* mod,
+                           uint8_t* packet, uint16_t length)
+{
+  ax_tx_async_slot* slot;
+  int32_t id;
+
+  if (!async->running || (length > AX_TX_ASYNC_MAX_LENGTH)) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&async->lock);
+
+  if ((async->submitted - async->done) == AX_TX_ASYNC_SLOTS) {
+    pthread_mutex_unlock(&async->lock);
+    return -1;                  /* full */
+  }
+
+  slot = &async->slot[async->submitted % AX_TX_ASYNC_SLOTS];
+  slot->mod = mod;
+  memcpy(slot->data, packet, length);
+  slot->length = length;
+  slot->id = id = async->submitted & 0x7FFFFFFF;
+  memset(&slot->timing, 0, sizeof(ax_tx_timing));
+  slot->timing.enqueue_us = ax_tx_async_time_us();
+  async->submitted++;
+
+  pthread_cond_broadcast(&async->wake);
+  pthread_mutex_unlock(&async->lock);
+
+  return id;
+}
+/**
+ * Waits for every submitted packet to be sent, then stops the worker
+ * thread
+ */
+void ax_tx_async_stop(ax_tx_async* async)
+{
+  if (!async->running) {
+    return;
+  }
+
+  pthread_mutex_lock(&async->lock);
+  async->stop = 1;
+  pthread_cond_broadcast(&async->wake);
+  pthread_mutex_unlock(&async->lock);
+
+  pthread_join(async->thread, NULL);
+  pthread_cond_destroy(&async->wake);
+  pthread_mutex_destroy(&async->lock);
+  async->running = 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Asynchronous transmit for ax radios
+ * Copyright (C) 2016  Richard Meadows <richardeoin>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AX_TX_ASYNC_H
+#define AX_TX_ASYNC_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ax/ax.h"
+
+/* longest packet that can be submitted */
+#define AX_TX_ASYNC_MAX_LENGTH	0x1000
+/* packets that can be waiting or in the fifo */
+#define AX_TX_ASYNC_SLOTS	16
+
+/**
+ * When things happened to a packet, in microseconds on CLOCK_MONOTONIC
+ */
+typedef struct ax_tx_timing {
+  uint64_t enqueue_us;          /* ax_tx_async_submit called */
+  uint64_t first_byte_us;       /* first byte written to the fifo */
+  uint64_t idle_us;             /* sent. RADIOSTATE idle if it was the last
+                                 * packet, else it left the fifo */
+} ax_tx_timing;
+
+/**
+ * Called from the worker thread when a packet has been sent
+ */
+typedef void (*ax_tx_async_done)(uint32_t id, ax_tx_timing* timing,
+                                 void* context);
+
+/**
+ * A packet waiting to be sent, or in the fifo
+ */
+typedef struct ax_tx_async_slot {
+  ax_modulation* mod;
+  uint8_t data[AX_TX_ASYNC_MAX_LENGTH];
+  uint16_t length;
+  uint32_t id;
+  uint32_t fifo_end;            /* fifo_tx_written after the packet */
+  ax_tx_timing timing;
+} ax_tx_async_slot;
+
+/**
+ * Worker thread that owns the radio, one per ax_config. Zero it before
+ * the first ax_tx_async_start. Slots from done to sent are in the fifo,
+ * slots from sent to submitted are waiting. All indexes only ever
+ * increase.
+ */
+typedef struct ax_tx_async {
+  ax_config* config;
+  ax_tx_async_done done_callback;
+  void* context;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  int running;
+  int stop;
+
+  ax_tx_async_slot slot[AX_TX_ASYNC_SLOTS];
+  uint32_t submitted;
+  uint32_t sent;
+  uint32_t done;
+} ax_tx_async;
+
+int ax_tx_async_start(ax_tx_async* async, ax_config* config,
+                      ax_tx_async_done done, void* context);
+int32_t ax_tx_async_submit(ax_tx_async* async, ax_modulation* mod,
+                           uint8_t* packet, uint16_t length);
+void ax_tx_async_stop(ax_tx_async* async);
+
+#endif  /* AX_TX_ASYNC_H */
@@ -0,0 +1,115 @@
+# Throughput and latency benchmarks for the driver, on the emulated radio
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator:
+#   python ax_build_dummy.py emulator
+#   python tests/bench_emulator.py
+# or `make bench`. Times include the python calls into the driver.
+
+import os
+import sys
+import time
+import statistics
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+tx_buffer = ffi.new('uint8_t[]', 0x10000)
+
+def payload(length):
+    return bytes(i & 0xFF for i in range(length))
+
+# packets per second, payload bytes per second, and spi traffic per
+# packet through ax_tx_packet. the fifo empties instantly
+def bench_tx(radio, length, count):
+    data = payload(length)
+    trace = ffi.new('ax_trace*') # just counts
+    radio.transmit(data)         # turn the transmitter on
+    lib.ax_emulator_tx_read(tx_buffer, len(tx_buffer))
+
+    radio.config.trace = trace
+    start = time.perf_counter()
+    for i in range(count):
+        radio.transmit(data)
+        lib.ax_emulator_tx_read(tx_buffer, len(tx_buffer))
+    elapsed = time.perf_counter() - start
+    radio.config.trace = ffi.NULL
+
+    print('tx {:5d} bytes: {:8.0f} packets/s {:8.0f} kB/s '
+          '{:5.1f} transactions {:6.0f} spi bytes per packet'.format(
+              length, count / elapsed, count * length / elapsed / 1000,
+              trace.transactions / count, trace.bytes / count))
+
+# packets per second read back through ax_rx_packets, in batches as
+# large as the fifo holds
+def bench_rx(radio, length, count):
+    data = payload(length)
+    per_fifo = max(1, 200 // (length + 10))
+    radio.receive_packets(timeout=0) # turn the receiver on
+
+    received = 0
+    start = time.perf_counter()
+    while received < count:
+        for i in range(per_fifo):
+            lib.ax_emulator_rx_packet(data, length, 0)
+        received += len(radio.receive_packets(timeout=0))
+    elapsed = time.perf_counter() - start
+
+    print('rx {:5d} bytes: {:8.0f} packets/s {:8.0f} kB/s'.format(
+        length, received / elapsed, received * length / elapsed / 1000))
+
+# time from a packet landing in the fifo to the consumer waking with
+# it, through the rx thread and ring
+def bench_rx_latency(radio, count):
+    data = payload(32)
+    radio.receive_packets(timeout=0) # receiver on, ring empty
+    assert lib.ax_rx_thread_start(radio.config, radio.rx_ring) == 0
+    radio.rx_running = True
+
+    latency = []
+    for i in range(count):
+        lib.ax_rx_thread_lock(radio.rx_ring)
+        start = time.perf_counter()
+        lib.ax_emulator_rx_packet(data, len(data), 0)
+        lib.ax_rx_thread_unlock(radio.rx_ring)
+
+        lib.ax_rx_ring_wait(radio.rx_ring, 1000)
+        latency.append((time.perf_counter() - start) * 1e6)
+        lib.ax_rx_ring_release(radio.rx_ring)
+        time.sleep(0.001)
+    radio.receive_stop()
+
+    latency.sort()
+    print('rx latency via ring: median {:.0f} us, 99% {:.0f} us'.format(
+        statistics.median(latency), latency[int(len(latency) * 0.99)]))
+
+if __name__ == "__main__":
+    radio = AxRadio()
+
+    for length in [16, 255, 1024, 4096]:
+        bench_tx(radio, length, 2000 if length < 1024 else 500)
+    for length in [16, 64, 200]:
+        bench_rx(radio, length, 20000)
+    bench_rx_latency(radio, 500)
+
+    radio.off()
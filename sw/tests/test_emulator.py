@@ -0,0 +1,98 @@
+# Checks the emulated radio against the driver
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`
+
+import os
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+def tx_read(length):
+    buffer = ffi.new('uint8_t[]', length)
+    n = lib.ax_emulator_tx_read(buffer, length)
+    return bytes(ffi.buffer(buffer, n))
+
+# a packet comes out of the fifo whole, and the same each time
+def test_tx_packet(radio):
+    data = bytes(i * 5 & 0xFF for i in range(50))
+    radio.transmit(data)
+    sent = tx_read(0x1000)
+    assert data in sent
+
+    radio.transmit(data)
+    assert tx_read(0x1000) == sent
+
+# a packet put in the fifo is read back by ax_rx_packet
+def test_rx_packet(radio):
+    data = bytes(i * 3 & 0xFF for i in range(100))
+    pkt = ffi.new('ax_packet*')
+
+    lib.ax_rx_on(radio.config, radio.mod)
+    assert lib.ax_rx_packet(radio.config, pkt) == 0
+    lib.ax_emulator_rx_packet(data, len(data), 0x40)
+    assert lib.ax_rx_packet(radio.config, pkt) == 1
+    assert bytes(ffi.buffer(pkt.data, pkt.length)) == data
+    assert lib.ax_rx_packet(radio.config, pkt) == 0
+
+# the sent bytes stay in order across the end of the tx ring
+def test_tx_wrap(radio):
+    data = bytes(i * 7 & 0xFF for i in range(1000))
+    radio.transmit(data)
+    tx_read(0x10000)
+    radio.transmit(data)
+    reference = tx_read(0x10000) # bytes for one packet
+
+    received = b''
+    for i in range(200):         # ~3 times round
+        radio.transmit(data)
+        received += tx_read(1000) # lag behind
+    received += tx_read(0x10000)
+
+    assert received == reference * 200, 'tx bytes corrupted at the wrap'
+    assert lib.ax_emulator_tx_dropped() == 0
+
+# bytes that don't fit are dropped and counted, those kept are intact
+def test_tx_overflow(radio):
+    data = bytes(i & 0xFF for i in range(4096))
+    radio.transmit(data)
+    reference = tx_read(0x10000)
+
+    for i in range(20):         # 80kB without reading
+        radio.transmit(data)
+    kept = tx_read(0x20000)
+
+    assert len(kept) == 0x10000
+    assert lib.ax_emulator_tx_dropped() == len(reference) * 20 - 0x10000
+    whole = 0x10000 // len(reference)
+    assert kept[:whole * len(reference)] == reference * whole
+
+
+
+if __name__ == "__main__":
+    for test in [test_tx_packet, test_rx_packet, test_tx_wrap, test_tx_overflow]:
+        radio = AxRadio()        # resets the emulator
+        test(radio)
+        radio.off()
+        print('{} ok'.format(test.__name__))
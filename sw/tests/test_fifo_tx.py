@@ -0,0 +1,173 @@
+# Checks the FIFO byte stream for transmitted packets of every length
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`.
+#
+# For every length from 1 to 4096 the packet is sent through
+# ax_tx_packet, ax_tx_enqueue/ax_tx_flush and ax_tx_async, with pattern
+# match and HDLC framing. The stream read back from the emulator must
+# hold the preamble, then DATA chunks with PKTSTART on the first and
+# PKTEND on the last that reassemble to the packet, and must be the same
+# byte for byte on every path. When the transmitter drains the FIFO
+# slowly the chunks are smaller, but must still reassemble the same.
+
+import os
+import sys
+import time
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+CHUNK_DATA = 0xE1
+CHUNK_REPEATDATA = 0x62
+CHUNK_TXPWR = 0xFD
+PKTSTART = 0x01
+PKTEND = 0x02
+RAW = 0x10
+
+MAX_LENGTH = 4096
+
+tx_buffer = ffi.new('uint8_t[]', 0x10000)
+
+def tx_read():
+    n = lib.ax_emulator_tx_read(tx_buffer, len(tx_buffer))
+    return bytes(ffi.buffer(tx_buffer, n))
+
+def payload(length):
+    return bytes((i * 13 + length) & 0xFF for i in range(length))
+
+# split the stream into (header, body) chunks
+def chunks(stream):
+    i = 0
+    while i < len(stream):
+        header = stream[i]
+        size = {0: 1, 1: 2, 2: 3, 3: 4}.get(header >> 5)
+        if header >> 5 == 7:
+            assert i + 1 < len(stream), 'chunk runs past the end'
+            size = 2 + stream[i + 1]
+        assert size, 'unknown chunk {:02x}'.format(header)
+        assert i + size <= len(stream), 'chunk runs past the end'
+        yield header, stream[i + 1:i + size]
+        i += size
+
+# the packet carried in stream, checking the framing around it
+def reassemble(stream, hdlc):
+    data = b''
+    started = ended = False
+    for header, body in chunks(stream):
+        if header == CHUNK_TXPWR:
+            assert not started, 'power chunk inside a packet'
+        elif header == CHUNK_REPEATDATA:
+            assert not started, 'preamble inside a packet'
+        elif header == CHUNK_DATA:
+            flags = body[1]
+            if flags & RAW:     # sync word
+                assert not started and not hdlc
+                continue
+            assert not ended, 'data after PKTEND'
+            assert bool(flags & PKTSTART) == (not started), \
+                'PKTSTART must only be on the first chunk'
+            started = True
+            ended = bool(flags & PKTEND)
+            data += body[2:]
+        else:
+            assert False, 'unexpected chunk {:02x}'.format(header)
+    assert started and ended, 'packet not terminated'
+    return data
+
+def expected(data, hdlc):
+    if hdlc or len(data) >= 255:
+        return data
+    return bytes([len(data) + 1]) + data # length byte
+
+def send_packet(radio, data):
+    radio.transmit(data)
+
+def send_burst(radio, data):
+    radio.transmit_burst([data])
+
+def send_async(radio, data):
+    radio.transmit_async(data)
+    radio.transmit_async_wait()
+
+paths = [send_packet, send_burst, send_async]
+
+def check_lengths(fec, lengths):
+    radio = AxRadio(fec=fec)
+    hdlc = fec
+    for send in paths:          # a short packet through each path first
+        send(radio, b'x')
+    tx_read()
+
+    for length in lengths:
+        data = payload(length)
+        streams = []
+        for send in paths:
+            send(radio, data)
+            streams.append(tx_read())
+
+        assert reassemble(streams[0], hdlc) == expected(data, hdlc), \
+            'length {} reassembled wrongly'.format(length)
+        for send, stream in zip(paths, streams):
+            assert stream == streams[0], \
+                'length {} differs through {}'.format(length, send.__name__)
+
+    assert lib.ax_emulator_tx_dropped() == 0
+    radio.off()
+
+# reads until the packet has been sent, and returns it
+def drain_packet(length):
+    stream = b''
+    deadline = time.time() + 1
+    while True:
+        stream += tx_read()
+        try:
+            return reassemble(stream, False)
+        except AssertionError:
+            assert time.time() < deadline, \
+                'length {} never finished'.format(length)
+            time.sleep(0.001)
+
+def check_slow_drain(lengths):
+    radio = AxRadio()
+    lib.ax_emulator_set_tx_rate(200000) # 25x slower than written
+    radio.transmit(b'x')
+    drain_packet(1)
+
+    for length in lengths:
+        data = payload(length)
+        radio.transmit(data)
+        assert drain_packet(length) == expected(data, False), \
+            'length {} reassembled wrongly with slow drain'.format(length)
+
+    lib.ax_emulator_set_tx_rate(0)
+    radio.off()
+
+if __name__ == "__main__":
+    lengths = range(1, MAX_LENGTH + 1)
+    check_lengths(False, lengths)
+    print('pattern match framing, lengths 1 to {} ok'.format(MAX_LENGTH))
+    check_lengths(True, lengths)
+    print('hdlc framing, lengths 1 to {} ok'.format(MAX_LENGTH))
+    check_slow_drain(list(range(1, 300)) + list(range(300, MAX_LENGTH + 1, 37)))
+    print('slow drain ok')
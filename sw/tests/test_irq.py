@@ -0,0 +1,88 @@
+# Checks the driver sleeps on the IRQ pin, using the emulator's eventfd
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`
+
+import os
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+# irq_wait on the emulator's eventfd, through ax_irq_wait. returns a
+# list with 1 for each wait that was woken by an edge, 0 for a timeout
+def irq_source(radio):
+    fd = lib.ax_emulator_irq_open()
+    assert fd >= 0
+    woken = []
+
+    @ffi.callback("void(ax_config*, uint32_t)")
+    def irq_wait(config, timeout_ms):
+        woken.append(lib.ax_irq_wait(fd, timeout_ms))
+
+    radio.irq_wait_callback = irq_wait # keep alive
+    radio.config.irq_wait = irq_wait
+    return woken
+
+# waits for tx fifo space end on FIFOTHRFREE, not the timeout
+def test_tx_wait(radio):
+    woken = irq_source(radio)
+
+    lib.ax_emulator_set_tx_rate(20000) # 2000 bytes takes 100ms
+    radio.transmit(bytes(2000))
+    lib.ax_emulator_set_tx_rate(0)
+
+    assert len(woken) > 0, 'never waited for fifo space'
+    assert woken.count(0) == 0, '{} of {} waits timed out'.format(
+        woken.count(0), len(woken))
+
+# a receiver waiting for its first packet is woken by FIFOTHRCNT. the
+# packet arrives as the third wait starts, so a timed out slice can't
+# find it first
+def test_rx_wait(radio):
+    fd = lib.ax_emulator_irq_open()
+    assert fd >= 0
+    woken = []
+
+    @ffi.callback("void(ax_config*, uint32_t)")
+    def irq_wait(config, timeout_ms):
+        if len(woken) == 2:
+            lib.ax_emulator_rx_packet(bytes(32), 32, 0x40)
+        woken.append(lib.ax_irq_wait(fd, timeout_ms))
+
+    radio.irq_wait_callback = irq_wait # keep alive
+    radio.config.irq_wait = irq_wait
+    radio.config.irq_rx = 1
+    radio.receive_packets(timeout=0) # receiver on
+
+    packets = radio.receive_packets(timeout=2)
+    assert len(packets) == 1
+    assert woken == [0, 0, 1], 'waits ended {}'.format(woken)
+
+if __name__ == "__main__":
+    for test in [test_tx_wait, test_rx_wait]:
+        radio = AxRadio()        # resets the emulator
+        test(radio)
+        radio.off()
+        lib.ax_emulator_irq_close()
+        print('{} ok'.format(test.__name__))
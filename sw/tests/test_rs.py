@@ -0,0 +1,114 @@
+# Round trip test for Reed-Solomon coding and interleaving
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Run with `make test`. Frames are encoded with ax_rs_encode, hit with a
+# burst of up to 16*depth bytes (or 16 per codeword, if there are fewer),
+# and must decode back to the data
+
+import os
+import sys
+import random
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+
+FRAME_MAX = 0x1000
+
+def encode(data, shortening, depth):
+    frame = ffi.new('uint8_t[]', FRAME_MAX)
+    n = lib.ax_rs_encode(data, len(data), shortening, depth, frame, FRAME_MAX)
+    assert n == lib.ax_rs_encoded_length(len(data), shortening)
+    return bytearray(ffi.buffer(frame, n))
+
+def decode(frame, shortening, depth):
+    data = ffi.new('uint8_t[]', FRAME_MAX)
+    length = ffi.new('uint16_t*')
+    corrected = lib.ax_rs_decode(bytes(frame), len(frame),
+                                 shortening, depth, data, length)
+    return corrected, bytes(ffi.buffer(data, length[0]))
+
+def burst(frame, offset, length, rng):
+    for i in range(offset, min(offset + length, len(frame))):
+        frame[i] ^= rng.randrange(1, 256)
+
+def check(data, shortening, depth, offset, length, rng):
+    frame = encode(data, shortening, depth)
+    burst(frame, offset, length, rng)
+    corrected, decoded = decode(frame, shortening, depth)
+    assert corrected >= 0 and decoded == data, \
+        'length {} shortening {} depth {}: burst of {} at {} not corrected'.format(
+            len(data), shortening, depth, length, offset)
+
+def test_full_codeword_bursts(rng):
+    # every codeword full length, in whole groups of depth
+    for n in range(500):
+        shortening = rng.choice([0, rng.randrange(223)])
+        depth = rng.randrange(1, 9)
+        k = 223 - shortening
+        groups = FRAME_MAX // ((255 - shortening) * depth)
+        if groups == 0:
+            continue
+        blocks = depth * rng.randrange(1, groups + 1)
+        data = bytes(rng.randrange(256) for i in range(k * blocks))
+        frame_length = lib.ax_rs_encoded_length(len(data), shortening)
+
+        burst_length = rng.randrange(1, 16 * depth + 1)
+        offset = rng.randrange(frame_length)
+        check(data, shortening, depth, offset, burst_length, rng)
+
+def test_short_last_codeword(rng):
+    # a burst in the tail of a group with a short codeword
+    data = bytes(rng.randrange(256) for i in range(276))
+    for offset in range(0, len(encode(data, 0, 2)) - 32):
+        check(data, 0, 2, offset, 32, rng)
+
+def test_random_bursts(rng):
+    for n in range(2000):
+        shortening = rng.choice([0, 0, rng.randrange(223)])
+        depth = rng.randrange(1, 9)
+        k = 223 - shortening
+        length = rng.randrange(1, (FRAME_MAX * k) // (k + 32))
+        if lib.ax_rs_encoded_length(length, shortening) > FRAME_MAX:
+            continue
+        data = bytes(rng.randrange(256) for i in range(length))
+        frame_length = lib.ax_rs_encoded_length(length, shortening)
+        blocks = (length + k - 1) // k
+
+        burst_length = rng.randrange(1, 16 * min(depth, blocks) + 1)
+        offset = rng.randrange(frame_length)
+        check(data, shortening, depth, offset, burst_length, rng)
+
+def test_every_length(rng):
+    for length in range(1, 1000):
+        data = bytes(rng.randrange(256) for i in range(length))
+        for depth in [1, 3]:
+            corrected, decoded = decode(encode(data, 0, depth), 0, depth)
+            assert (corrected, decoded) == (0, data), \
+                'length {} depth {}'.format(length, depth)
+
+
+if __name__ == "__main__":
+    rng = random.Random(17)
+    for test in [test_full_codeword_bursts, test_short_last_codeword,
+                 test_random_bursts, test_every_length]:
+        test(rng)
+        print('{} ok'.format(test.__name__))
@@ -0,0 +1,111 @@
+# Checks packets whose metadata and data arrive in separate reads
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`
+
+import os
+import sys
+import threading
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+def rx_load(data):
+    assert lib.ax_emulator_rx_load(bytes(data), len(data)) == len(data)
+
+# runs ax_rx_packet with a deadline, so a driver that waits for data
+# that isn't coming fails rather than hangs
+def rx_packet(radio, pkt):
+    result = []
+    t = threading.Thread(target=lambda: result.append(
+        lib.ax_rx_packet(radio.config, pkt)), daemon=True)
+    t.start()
+    t.join(2)
+    assert result, 'ax_rx_packet did not return'
+    return result[0]
+
+# TIMER and RSSI in one read, the DATA chunk in the next
+def test_split_metadata(radio):
+    pkt = ffi.new('ax_packet*')
+
+    rx_load([0x70, 0x01, 0x02, 0x03, 0x31, 0x4d]) # TIMER, RSSI
+    assert rx_packet(radio, pkt) == 0
+
+    rx_load([0xe1, 0x04, 0x03, 0x09, 0x09, 0x09]) # DATA, start and end
+    assert rx_packet(radio, pkt) == 1
+    assert bytes(ffi.buffer(pkt.data, pkt.length)) == b'\x09\x09\x09'
+    assert pkt.timer == 0x010203
+    assert pkt.rssi == 0x4d - 0x100 # sign-extended from 8 bits
+
+    # the next packet doesn't carry the last one's metadata
+    rx_load([0xe1, 0x03, 0x03, 0x0a, 0x0a])
+    assert rx_packet(radio, pkt) == 1
+    assert bytes(ffi.buffer(pkt.data, pkt.length)) == b'\x0a\x0a'
+    assert pkt.timer == 0
+    assert pkt.rssi == 0
+
+# a packet without all its metadata is returned at PKTEND
+def test_missing_metadata(radio):
+    pkt = ffi.new('ax_packet*')
+
+    rx_load([0x31, 0x20])       # RSSI, no TIMER
+    rx_load([0xe1, 0x03, 0x03, 0x55, 0xaa])
+    assert rx_packet(radio, pkt) == 1
+    assert bytes(ffi.buffer(pkt.data, pkt.length)) == b'\x55\xaa'
+    assert pkt.rssi == 0x20 - 0x100
+    assert pkt.timer == 0
+    assert rx_packet(radio, pkt) == 0
+
+# a chunk longer than one burst is read in one call, as FIFOCOUNT said
+# the rest was already there
+def test_long_chunk(radio):
+    pkt = ffi.new('ax_packet*')
+    data = bytes(range(253))
+
+    rx_load([0xe1, 0xfe, 0x03] + list(data)) # all 256 bytes of the fifo
+    assert rx_packet(radio, pkt) == 1
+    assert bytes(ffi.buffer(pkt.data, pkt.length)) == data
+    assert radio.config.state.fifo_rx_overflows == 0
+
+# the rx ring is only made once the radio receives, and close frees it
+def test_ring_close(radio):
+    fds = len(os.listdir('/proc/self/fd'))
+    assert radio.rx_ring is None
+
+    radio.receive_packets(timeout=0)
+    assert radio.rx_ring is not None
+    radio.close()
+    assert radio.rx_ring is None
+    assert len(os.listdir('/proc/self/fd')) == fds, 'rx ring leaked'
+
+
+if __name__ == "__main__":
+    for test in [test_split_metadata, test_missing_metadata, test_long_chunk,
+                 test_ring_close]:
+        radio = AxRadio()        # resets the emulator
+        radio.config.pkt_store_flags = lib.AX_PKT_STORE_TIMER | \
+                                       lib.AX_PKT_STORE_RSSI
+        lib.ax_rx_on(radio.config, radio.mod)
+        test(radio)
+        radio.off()
+        print('{} ok'.format(test.__name__))
@@ -0,0 +1,96 @@
+# Replays a committed SPI trace through the driver
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`.
+#
+# replay.trace was recorded from the scenario below on the emulator. It
+# covers ax_init, ax_set_registers (from ax_tx_on and ax_rx_on),
+# ax_fifo_tx_data and ax_rx_packet. Replaying it checks that the driver
+# still makes the same transactions, and reads the same packets back
+# from the log. After a deliberate change to what the driver sends,
+# check the new behaviour and then re-record with
+#   python tests/test_trace_replay.py record
+
+import os
+import sys
+import threading
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+LOG = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'replay.trace')
+
+tx_lengths = [1, 100, 254, 255, 600]
+rx_lengths = [1, 32, 150] # all fit in the fifo at once
+
+def payload(length):
+    return bytes((i * 3 + length) & 0xFF for i in range(length))
+
+def scenario(radio, emulated):
+    for length in tx_lengths:
+        radio.transmit(payload(length))
+    radio.transmit_burst([payload(10), payload(20)])
+
+    radio.receive_packets(timeout=0) # receiver on
+    if emulated:
+        for length in rx_lengths:
+            lib.ax_emulator_rx_packet(payload(length), length, 0x40)
+    received = [bytes(p) for p in radio.receive_packets(timeout=0)]
+
+    radio.off()
+    return received
+
+def record():
+    radio = AxRadio(trace=LOG)
+    received = scenario(radio, True)
+    radio.trace_close()
+    assert received == [payload(n) for n in rx_lengths]
+
+def test_replay():
+    radio = AxRadio(replay=LOG)
+    result = []
+
+    # a driver that has drifted from the log can wait forever on the
+    # answers it gets back, so give up rather than hang
+    t = threading.Thread(target=lambda: result.append(
+        scenario(radio, False)), daemon=True)
+    t.start()
+    t.join(30)
+    assert result, 'replay stuck, the driver no longer matches {}'.format(LOG)
+    received = result[0]
+    mismatches = radio.trace_close()
+
+    assert mismatches == 0, '{} transactions differ from {}'.format(
+        mismatches, LOG)
+    assert radio.trace_player.index == radio.trace.transactions
+    assert received == [payload(n) for n in rx_lengths], \
+        'packets not read back from the log'
+
+
+if __name__ == "__main__":
+    if 'record' in sys.argv:
+        record()
+        print('recorded {}'.format(LOG))
+    else:
+        test_replay()
+        print('test_replay ok')
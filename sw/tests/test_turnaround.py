@@ -0,0 +1,61 @@
+# Checks that turnarounds pick up a modulation changed in place
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`
+
+import os
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib
+from ax_radio import AxRadio
+
+AX_REG_TXRATE = 0x165
+
+def txrate():
+    return ((lib.ax_emulator_register(AX_REG_TXRATE) << 16) |
+            (lib.ax_emulator_register(AX_REG_TXRATE + 1) << 8) |
+            lib.ax_emulator_register(AX_REG_TXRATE + 2))
+
+# the same ax_modulation with a new bitrate must be set up in full,
+# not turned around with the old registers
+def test_mod_changed(radio):
+    radio.transmit(bytes(10))
+    radio.turnaround()          # to rx
+    before = txrate()
+
+    radio.mod.bitrate = radio.mod.bitrate // 2
+    radio.turnaround()          # to tx
+    assert txrate() != before
+
+    radio.transmit(bytes(10))
+    radio.turnaround()          # and back, with the registers now set
+    radio.turnaround()
+    assert txrate() != before
+
+
+if __name__ == "__main__":
+    for test in [test_mod_changed]:
+        radio = AxRadio()        # resets the emulator
+        test(radio)
+        radio.off()
+        print('{} ok'.format(test.__name__))
@@ -0,0 +1,56 @@
+# Checks the times reported for packets sent with transmit_async
+# Copyright (C) 2016  Richard Meadows <richardeoin>
+
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Needs the module built against the emulator, run with `make test`
+
+import os
+import sys
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..'))
+
+from _ax_radio import lib, ffi
+from ax_radio import AxRadio
+
+# a packet queued behind another is written once the fifo has room,
+# and its first byte time says so rather than when it was dequeued
+def test_first_byte(radio):
+    timings = []
+
+    lib.ax_emulator_set_tx_rate(20000) # 200 bytes takes 10ms
+    for i in range(4):
+        radio.transmit_async(bytes(200), done=timings.append)
+    radio.transmit_async_wait()
+    lib.ax_emulator_set_tx_rate(0)
+
+    assert len(timings) == 4
+    for t in timings:
+        assert t['enqueue_us'] <= t['first_byte_us'] <= t['idle_us']
+    for a, b in zip(timings, timings[1:]):
+        # the 256 byte fifo can't hold both, so some of a must drain
+        assert b['first_byte_us'] - a['first_byte_us'] > 2000
+
+
+if __name__ == "__main__":
+    for test in [test_first_byte]:
+        radio = AxRadio()        # resets the emulator
+        test(radio)
+        radio.off()
+        print('{} ok'.format(test.__name__))